@@ -0,0 +1,309 @@
+// Copyright (C) 2015 Ben Lewis <benjf5+github@gmail.com>
+// Licensed under the MIT license.
+
+#include "uri.hh"
+#include "uri_reader.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if defined(_WIN32)
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifndef URI_CORPUS_DIR
+#define URI_CORPUS_DIR "corpus"
+#endif
+
+/* Runs the library's common operations over the bundled corpora in corpus/,
+ * one URI per line, and reports for each the time taken per URI, the
+ * throughput in bytes of URI text per second, the heap allocations made per
+ * URI, and the peak resident set size of the process so far. Pass --quick to
+ * run each operation once, as the smoke test does, and a directory to read
+ * the corpora from somewhere other than the source tree.
+ */
+
+std::atomic<size_t> allocation_count(0);
+
+void *operator new(size_t size)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (void *memory = std::malloc(size ? size : 1))
+  {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+// These replace the global operators, so memory from new is always malloc's,
+// but GCC inlines them and warns that free() is given memory from new. Sized
+// delete forwards to the unsized one, so only that needs the warning off.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *memory) noexcept
+{
+  std::free(memory);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+void operator delete(void *memory, size_t) noexcept
+{
+  operator delete(memory);
+}
+
+// std::pmr's default resource allocates through the aligned forms, so uri's
+// buffers are only counted if these are replaced too.
+void *operator new(size_t size, std::align_val_t alignment)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  size_t const align = static_cast<size_t>(alignment);
+#if defined(_WIN32)
+  if (void *memory = _aligned_malloc((size ? size : 1), align))
+#else
+  if (void *memory = std::aligned_alloc(align, (((size ? size : 1) + align - 1) / align) * align))
+#endif
+  {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+#if defined(_WIN32)
+  _aligned_free(memory);
+#else
+  std::free(memory);
+#endif
+}
+
+void operator delete(void *memory, size_t, std::align_val_t alignment) noexcept
+{
+  operator delete(memory, alignment);
+}
+
+size_t peak_resident_bytes()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+bool quick = false;
+
+// Runs the body once to warm up, then enough times to take at least a
+// quarter of a second (or just once more, when quick), and reports the
+// time, throughput and allocations per URI for one run.
+template <typename Body>
+void measure(char const *what, size_t uri_count, size_t byte_count, Body body)
+{
+  using clock = std::chrono::steady_clock;
+
+  body();
+  size_t const allocations_before = allocation_count.load();
+  body();
+  size_t const allocations = allocation_count.load() - allocations_before;
+
+  size_t runs = 0;
+  clock::duration elapsed(0);
+  do
+  {
+    clock::time_point const start = clock::now();
+    body();
+    elapsed += clock::now() - start;
+    ++runs;
+  } while (!quick && (elapsed < std::chrono::milliseconds(250)));
+
+  double const seconds = std::chrono::duration<double>(elapsed).count() / static_cast<double>(runs);
+  std::cout << "  " << std::left << std::setw(40) << what << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << ((seconds * 1e9) / static_cast<double>(uri_count)) << " ns/URI"
+            << std::setw(10) << ((static_cast<double>(byte_count) / seconds) / 1e6) << " MB/s"
+            << std::setprecision(2) << std::setw(8)
+            << (static_cast<double>(allocations) / static_cast<double>(uri_count)) << " allocs/URI" << std::endl;
+}
+
+void run_corpus(std::string const &directory, char const *name)
+{
+  std::string const path = directory + "/" + name;
+  mapped_file const file(path.c_str());
+
+  std::vector<std::string_view> lines;
+  size_t bytes = 0;
+  std::string_view line;
+  size_t cursor = 0;
+  while (uri_detail::next_line(file.contents(), cursor, line))
+  {
+    lines.push_back(line);
+    bytes += line.length();
+  }
+
+  std::vector<uri> parsed;
+  size_t malformed = 0;
+  for (std::string_view const text : lines)
+  {
+    uri::parse_result<uri> result = uri::try_parse(text);
+    if (result)
+    {
+      parsed.push_back(std::move(result.value()));
+    }
+    else
+    {
+      ++malformed;
+    }
+  }
+  std::cout << name << ": " << lines.size() << " URIs, " << (bytes / std::max<size_t>(lines.size(), 1))
+            << " bytes on average, " << malformed << " malformed" << std::endl;
+
+  size_t sink = 0;
+  measure("uri_view::try_parse", lines.size(), bytes, [&]() {
+    for (std::string_view const text : lines)
+    {
+      sink += uri_view::try_parse(text).error_offset();
+    }
+  });
+
+  measure("uri::try_parse", lines.size(), bytes, [&]() {
+    for (std::string_view const text : lines)
+    {
+      uri::parse_result<uri> const result = uri::try_parse(text);
+      sink += result ? result->serialized_size() : result.error_offset();
+    }
+  });
+
+  if (malformed != 0)
+  {
+    measure("throwing constructor, catching errors", lines.size(), bytes, [&]() {
+      for (std::string_view const text : lines)
+      {
+        try
+        {
+          sink += uri(std::string(text)).serialized_size();
+        }
+        catch (std::invalid_argument const &)
+        {
+          ++sink;
+        }
+      }
+    });
+  }
+
+  if (parsed.empty())
+  {
+    std::cout << std::endl;
+    return;
+  }
+
+  size_t parsed_bytes = 0;
+  for (uri const &value : parsed)
+  {
+    parsed_bytes += value.serialized_size();
+  }
+
+  measure("to_string()", parsed.size(), parsed_bytes, [&]() {
+    for (uri const &value : parsed)
+    {
+      sink += value.to_string().length();
+    }
+  });
+
+  std::string buffer;
+  measure("to_string(std::string &), reused", parsed.size(), parsed_bytes, [&]() {
+    for (uri const &value : parsed)
+    {
+      value.to_string(buffer);
+      sink += buffer.length();
+    }
+  });
+
+  // The query index is built once and cached, so each run starts from new
+  // URIs; compare with uri::try_parse above for the cost of the dictionary.
+  measure("uri::try_parse + get_query_dictionary()", lines.size(), bytes, [&]() {
+    for (std::string_view const text : lines)
+    {
+      uri::parse_result<uri> const result = uri::try_parse(text);
+      sink += result ? result->get_query_dictionary().size() : 0;
+    }
+  });
+
+  std::vector<uri> copies;
+  copies.reserve(parsed.size());
+  measure("copy", parsed.size(), parsed_bytes, [&]() {
+    copies.clear();
+    for (uri const &value : parsed)
+    {
+      copies.push_back(value);
+    }
+  });
+
+  std::vector<uri> moved;
+  moved.reserve(parsed.size());
+  measure("move", parsed.size(), parsed_bytes, [&]() {
+    moved.clear();
+    for (uri &value : copies)
+    {
+      moved.push_back(std::move(value));
+    }
+    copies.swap(moved);
+    moved.clear();
+  });
+
+  std::cout << "  peak RSS so far: " << (peak_resident_bytes() / 1024) << " KiB"
+            << "  (checksum " << (sink % 1000) << ")" << std::endl << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  std::string directory = URI_CORPUS_DIR;
+  for (int index = 1; index < argc; ++index)
+  {
+    if (std::strcmp(argv[index], "--quick") == 0)
+    {
+      quick = true;
+    }
+    else
+    {
+      directory = argv[index];
+    }
+  }
+
+  std::cout << "Running the URI library corpus benchmarks on " << directory << " ..." << std::endl << std::endl;
+  try
+  {
+    for (char const *name : { "short_api.txt", "long_tracking.txt", "ipv6.txt", "malformed.txt" })
+    {
+      run_corpus(directory, name);
+    }
+  }
+  catch (std::system_error const &error)
+  {
+    std::cerr << "Couldn't read a corpus: " << error.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
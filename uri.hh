@@ -2,11 +2,485 @@
 // Licensed under the MIT license.
 
 #pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <compare>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <stdexcept>
 #include <utility>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<format>)
+#include <format>
+#endif
+#endif
+
+// Define URI_USE_FMT to have uri formattable with the fmt library as well.
+#if defined(URI_USE_FMT)
+#include <fmt/format.h>
+#endif
+
+#if !defined(URI_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) \
+                               || (defined(__i386__) && defined(__SSE2__)))
+#define URI_HAVE_SSE2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define URI_TARGET_AVX2
+#else
+#define URI_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace uri_detail
+{
+  /* The parser spends most of its time looking for the next structural
+   * delimiter (':', '/', '?', '#', '@', ...) in a component. Rather than
+   * testing one character at a time, find_delimiter classifies the text in
+   * 16 or 32-byte blocks, building a bitmask of which positions in the block
+   * hold any of the delimiters, and jumps straight to the first set bit. AVX2
+   * is used when the CPU supports it, SSE2 otherwise on x86, and a scalar
+   * loop everywhere else (or when URI_NO_SIMD is defined).
+   */
+
+  template <char... Delimiters>
+  constexpr size_t find_delimiter_scalar(char const *text, size_t cursor, size_t length) noexcept
+  {
+    while ((cursor != length) && !((text[cursor] == Delimiters) || ...))
+    {
+      ++cursor;
+    }
+    return cursor;
+  }
+
+#if defined(URI_HAVE_SSE2)
+  inline unsigned count_trailing_zeros(std::uint32_t mask) noexcept
+  {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+  }
+
+  inline bool detect_avx2() noexcept
+  {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+      return false;
+    }
+    __cpuid(info, 1);
+    bool const os_saves_ymm = ((info[2] & (1 << 27)) != 0)
+      && ((_xgetbv(0) & 0x6) == 0x6);
+    __cpuidex(info, 7, 0);
+    return os_saves_ymm && ((info[1] & (1 << 5)) != 0);
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+  }
+
+  inline bool const cpu_has_avx2 = detect_avx2();
+
+  template <char... Delimiters>
+  inline std::uint32_t classify_block(__m128i block) noexcept
+  {
+    __m128i matches = _mm_setzero_si128();
+    ((matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, _mm_set1_epi8(Delimiters)))), ...);
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(matches));
+  }
+
+  template <char... Delimiters>
+  inline size_t find_delimiter_sse2(char const *text, size_t cursor, size_t length) noexcept
+  {
+    for (; (cursor + 16) <= length; cursor += 16)
+    {
+      std::uint32_t const mask =
+        classify_block<Delimiters...>(_mm_loadu_si128(reinterpret_cast<__m128i const *>(text + cursor)));
+      if (mask != 0)
+      {
+        return cursor + count_trailing_zeros(mask);
+      }
+    }
+    return find_delimiter_scalar<Delimiters...>(text, cursor, length);
+  }
+
+  template <char... Delimiters>
+  URI_TARGET_AVX2 inline std::uint32_t classify_block(__m256i block) noexcept
+  {
+    __m256i matches = _mm256_setzero_si256();
+    ((matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(Delimiters)))), ...);
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(matches));
+  }
+
+  template <char... Delimiters>
+  URI_TARGET_AVX2 inline size_t find_delimiter_avx2(char const *text, size_t cursor, size_t length) noexcept
+  {
+    for (; (cursor + 32) <= length; cursor += 32)
+    {
+      std::uint32_t const mask =
+        classify_block<Delimiters...>(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(text + cursor)));
+      if (mask != 0)
+      {
+        return cursor + count_trailing_zeros(mask);
+      }
+    }
+    return find_delimiter_sse2<Delimiters...>(text, cursor, length);
+  }
+#endif
+
+  // Returns the offset of the first of the delimiters at or after cursor, or
+  // the length of the text if there are none. During constant evaluation the
+  // scalar loop is used, so that URIs can be parsed at compile time.
+  template <char... Delimiters>
+  constexpr size_t find_delimiter(std::string_view text, size_t cursor) noexcept
+  {
+    if (std::is_constant_evaluated())
+    {
+      return find_delimiter_scalar<Delimiters...>(text.data(), cursor, text.length());
+    }
+#if defined(URI_HAVE_SSE2)
+    if (cpu_has_avx2)
+    {
+      return find_delimiter_avx2<Delimiters...>(text.data(), cursor, text.length());
+    }
+    return find_delimiter_sse2<Delimiters...>(text.data(), cursor, text.length());
+#else
+    return find_delimiter_scalar<Delimiters...>(text.data(), cursor, text.length());
+#endif
+  }
+
+  /* scan_path finds the end of a path (the first '?' or '#') as
+   * find_delimiter would, and in the same pass counts the '/'s before it and
+   * notes where the last one is, so that a path's segments are known once
+   * it's parsed. last_slash is left alone if there are none.
+   */
+  constexpr size_t scan_path_scalar(char const *text, size_t cursor, size_t length,
+                                    std::uint32_t &slashes, size_t &last_slash) noexcept
+  {
+    for (; (cursor != length) && (text[cursor] != '?') && (text[cursor] != '#'); ++cursor)
+    {
+      if (text[cursor] == '/')
+      {
+        ++slashes;
+        last_slash = cursor;
+      }
+    }
+    return cursor;
+  }
+
+#if defined(URI_HAVE_SSE2)
+  // Counts the slashes in a block that come before its first '?' or '#'.
+  inline bool count_path_slashes(std::uint32_t ends, std::uint32_t slash_mask, size_t cursor,
+                                 std::uint32_t &slashes, size_t &last_slash) noexcept
+  {
+    if (ends != 0)
+    {
+      slash_mask &= (ends & (0u - ends)) - 1;
+    }
+    if (slash_mask != 0)
+    {
+      slashes += static_cast<std::uint32_t>(std::popcount(slash_mask));
+      last_slash = cursor + static_cast<size_t>(std::bit_width(slash_mask)) - 1;
+    }
+    return ends != 0;
+  }
+
+  inline size_t scan_path_sse2(char const *text, size_t cursor, size_t length,
+                               std::uint32_t &slashes, size_t &last_slash) noexcept
+  {
+    for (; (cursor + 16) <= length; cursor += 16)
+    {
+      __m128i const block = _mm_loadu_si128(reinterpret_cast<__m128i const *>(text + cursor));
+      std::uint32_t const ends = classify_block<'?', '#'>(block);
+      if (count_path_slashes(ends, classify_block<'/'>(block), cursor, slashes, last_slash))
+      {
+        return cursor + count_trailing_zeros(ends);
+      }
+    }
+    return scan_path_scalar(text, cursor, length, slashes, last_slash);
+  }
+
+  URI_TARGET_AVX2 inline size_t scan_path_avx2(char const *text, size_t cursor, size_t length,
+                                               std::uint32_t &slashes, size_t &last_slash) noexcept
+  {
+    for (; (cursor + 32) <= length; cursor += 32)
+    {
+      __m256i const block = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(text + cursor));
+      std::uint32_t const ends = classify_block<'?', '#'>(block);
+      if (count_path_slashes(ends, classify_block<'/'>(block), cursor, slashes, last_slash))
+      {
+        return cursor + count_trailing_zeros(ends);
+      }
+    }
+    return scan_path_sse2(text, cursor, length, slashes, last_slash);
+  }
+#endif
+
+  constexpr size_t scan_path(std::string_view text, size_t cursor, std::uint32_t &slashes,
+                             size_t &last_slash) noexcept
+  {
+    if (std::is_constant_evaluated())
+    {
+      return scan_path_scalar(text.data(), cursor, text.length(), slashes, last_slash);
+    }
+#if defined(URI_HAVE_SSE2)
+    if (cpu_has_avx2)
+    {
+      return scan_path_avx2(text.data(), cursor, text.length(), slashes, last_slash);
+    }
+    return scan_path_sse2(text.data(), cursor, text.length(), slashes, last_slash);
+#else
+    return scan_path_scalar(text.data(), cursor, text.length(), slashes, last_slash);
+#endif
+  }
+
+  /* Percent-encoding spends most of its time copying characters that never
+   * need encoding. skip_unreserved finds the end of a run of RFC 3986
+   * unreserved characters (ALPHA / DIGIT / "-" / "." / "_" / "~") a block at
+   * a time, in the same way find_delimiter does, so that the run can be
+   * copied in bulk; letters are matched as one range by folding their case.
+   */
+
+  constexpr bool is_unreserved(char c) noexcept
+  {
+    char const folded = static_cast<char>(c | 0x20);
+    return ((folded >= 'a') && (folded <= 'z')) || ((c >= '0') && (c <= '9'))
+      || (c == '-') || (c == '.') || (c == '_') || (c == '~');
+  }
+
+  constexpr size_t skip_unreserved_scalar(char const *text, size_t cursor, size_t length) noexcept
+  {
+    while ((cursor != length) && is_unreserved(text[cursor]))
+    {
+      ++cursor;
+    }
+    return cursor;
+  }
+
+#if defined(URI_HAVE_SSE2)
+  // Sets the bytes of the block that lie within [low, high] to all ones.
+  inline __m128i in_range(__m128i bytes, char low, char high) noexcept
+  {
+    __m128i const span = _mm_set1_epi8(static_cast<char>(high - low));
+    __m128i const offset = _mm_sub_epi8(bytes, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_max_epu8(offset, span), span);
+  }
+
+  inline std::uint32_t unreserved_block(__m128i block) noexcept
+  {
+    __m128i matches = _mm_or_si128(in_range(_mm_or_si128(block, _mm_set1_epi8(0x20)), 'a', 'z'),
+                                   in_range(block, '0', '9'));
+    for (char const c : { '-', '.', '_', '~' })
+    {
+      matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+    }
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(matches));
+  }
+
+  inline size_t skip_unreserved_sse2(char const *text, size_t cursor, size_t length) noexcept
+  {
+    for (; (cursor + 16) <= length; cursor += 16)
+    {
+      std::uint32_t const mask =
+        ~unreserved_block(_mm_loadu_si128(reinterpret_cast<__m128i const *>(text + cursor))) & 0xFFFF;
+      if (mask != 0)
+      {
+        return cursor + count_trailing_zeros(mask);
+      }
+    }
+    return skip_unreserved_scalar(text, cursor, length);
+  }
+
+  URI_TARGET_AVX2 inline __m256i in_range(__m256i bytes, char low, char high) noexcept
+  {
+    __m256i const span = _mm256_set1_epi8(static_cast<char>(high - low));
+    __m256i const offset = _mm256_sub_epi8(bytes, _mm256_set1_epi8(low));
+    return _mm256_cmpeq_epi8(_mm256_max_epu8(offset, span), span);
+  }
+
+  URI_TARGET_AVX2 inline std::uint32_t unreserved_block(__m256i block) noexcept
+  {
+    __m256i matches = _mm256_or_si256(in_range(_mm256_or_si256(block, _mm256_set1_epi8(0x20)), 'a', 'z'),
+                                      in_range(block, '0', '9'));
+    for (char const c : { '-', '.', '_', '~' })
+    {
+      matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(c)));
+    }
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(matches));
+  }
+
+  URI_TARGET_AVX2 inline size_t skip_unreserved_avx2(char const *text, size_t cursor, size_t length) noexcept
+  {
+    for (; (cursor + 32) <= length; cursor += 32)
+    {
+      std::uint32_t const mask =
+        ~unreserved_block(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(text + cursor)));
+      if (mask != 0)
+      {
+        return cursor + count_trailing_zeros(mask);
+      }
+    }
+    return skip_unreserved_sse2(text, cursor, length);
+  }
+#endif
+
+  // Returns the offset of the first character at or after cursor that isn't
+  // unreserved, or the length of the text if there's none.
+  inline size_t skip_unreserved(std::string_view text, size_t cursor) noexcept
+  {
+#if defined(URI_HAVE_SSE2)
+    if (cpu_has_avx2)
+    {
+      return skip_unreserved_avx2(text.data(), cursor, text.length());
+    }
+    return skip_unreserved_sse2(text.data(), cursor, text.length());
+#else
+    return skip_unreserved_scalar(text.data(), cursor, text.length());
+#endif
+  }
+
+  /* A fast, non-cryptographic hash over a run of bytes, following the design
+   * of wyhash: the input is consumed 48 bytes at a time through three
+   * independent multiply-and-fold lanes, and short inputs are read as a few
+   * overlapping words rather than byte by byte.
+   */
+
+  inline std::uint64_t multiply_fold(std::uint64_t a, std::uint64_t b) noexcept
+  {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 const product = static_cast<unsigned __int128>(a) * b;
+    return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    std::uint64_t high;
+    std::uint64_t const low = _umul128(a, b, &high);
+    return low ^ high;
+#else
+    std::uint64_t const a_high = a >> 32, a_low = static_cast<std::uint32_t>(a);
+    std::uint64_t const b_high = b >> 32, b_low = static_cast<std::uint32_t>(b);
+    std::uint64_t const high_high = a_high * b_high, high_low = a_high * b_low;
+    std::uint64_t const low_high = a_low * b_high, low_low = a_low * b_low;
+    std::uint64_t const middle = high_low + low_high;
+    std::uint64_t const low = low_low + (middle << 32);
+    std::uint64_t const high = high_high + (middle >> 32) + ((middle < high_low) ? (1ull << 32) : 0)
+      + ((low < low_low) ? 1 : 0);
+    return low ^ high;
+#endif
+  }
+
+  inline std::uint64_t read_64(unsigned char const *bytes) noexcept
+  {
+    std::uint64_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+  }
+
+  inline std::uint64_t read_32(unsigned char const *bytes) noexcept
+  {
+    std::uint32_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+  }
+
+  // The value of each hex digit, indexed by character, or -1 for characters
+  // that aren't hex digits.
+  inline constexpr std::array<std::int8_t, 256> hex_digit_values = []() {
+    std::array<std::int8_t, 256> values{};
+    for (size_t c = 0; c < values.size(); ++c)
+    {
+      values[c] = ((c >= '0') && (c <= '9')) ? static_cast<std::int8_t>(c - '0')
+        : ((c >= 'a') && (c <= 'f')) ? static_cast<std::int8_t>(c - 'a' + 10)
+        : ((c >= 'A') && (c <= 'F')) ? static_cast<std::int8_t>(c - 'A' + 10)
+        : static_cast<std::int8_t>(-1);
+    }
+    return values;
+  }();
+
+  inline std::uint64_t hash_bytes(void const *data, size_t length, std::uint64_t seed = 0) noexcept
+  {
+    constexpr std::uint64_t secret[4] = { 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+                                          0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull };
+    unsigned char const *bytes = static_cast<unsigned char const *>(data);
+    seed ^= multiply_fold(seed ^ secret[0], secret[1]);
+
+    std::uint64_t a;
+    std::uint64_t b;
+    if (length <= 16)
+    {
+      if (length >= 4)
+      {
+        size_t const middle = (length >> 3) << 2;
+        a = (read_32(bytes) << 32) | read_32(bytes + middle);
+        b = (read_32(bytes + length - 4) << 32) | read_32(bytes + length - 4 - middle);
+      }
+      else if (length > 0)
+      {
+        a = (static_cast<std::uint64_t>(bytes[0]) << 16) | (static_cast<std::uint64_t>(bytes[length >> 1]) << 8)
+          | bytes[length - 1];
+        b = 0;
+      }
+      else
+      {
+        a = 0;
+        b = 0;
+      }
+    }
+    else
+    {
+      size_t remaining = length;
+      if (remaining > 48)
+      {
+        std::uint64_t lane_1 = seed;
+        std::uint64_t lane_2 = seed;
+        do
+        {
+          seed = multiply_fold(read_64(bytes) ^ secret[1], read_64(bytes + 8) ^ seed);
+          lane_1 = multiply_fold(read_64(bytes + 16) ^ secret[2], read_64(bytes + 24) ^ lane_1);
+          lane_2 = multiply_fold(read_64(bytes + 32) ^ secret[3], read_64(bytes + 40) ^ lane_2);
+          bytes += 48;
+          remaining -= 48;
+        }
+        while (remaining > 48);
+        seed ^= lane_1 ^ lane_2;
+      }
+
+      while (remaining > 16)
+      {
+        seed = multiply_fold(read_64(bytes) ^ secret[1], read_64(bytes + 8) ^ seed);
+        bytes += 16;
+        remaining -= 16;
+      }
+      a = read_64(bytes + remaining - 16);
+      b = read_64(bytes + remaining - 8);
+    }
+
+    return multiply_fold(secret[1] ^ length, multiply_fold(a ^ secret[1], b ^ seed));
+  }
+}
+
+class uri_view;
 
 class uri
 {
@@ -26,631 +500,3454 @@ class uri
 
 public:
 
-  enum class scheme_category
+  // Automatic is only accepted by the parsers, which replace it with the
+  // category of the scheme they find: NonHierarchical for mailto, urn and
+  // data, Hierarchical for the other well-known schemes, and for any other
+  // scheme Hierarchical only if a '/' follows its ':'.
+  enum class scheme_category : std::uint8_t
+  {
+    Hierarchical,
+    NonHierarchical,
+    Automatic
+  };
+
+  // The schemes that are recognized while parsing, whatever their case;
+  // every other scheme is "other".
+  enum class known_scheme : std::uint8_t
+  {
+    other,
+    http,
+    https,
+    ws,
+    wss,
+    ftp,
+    file,
+    mailto,
+    urn,
+    data
+  };
+
+  enum class component
+  {
+    Scheme,
+    Content,
+    Username,
+    Password,
+    Host,
+    Port,
+    Path,
+    Query,
+    Fragment
+  };
+
+  enum class query_argument_separator : std::uint8_t
+  {
+    ampersand,
+    semicolon
+  };
+
+  // What the host component holds, as classified while parsing it. An IPv4
+  // address must be a strict dotted quad (four decimal octets, without
+  // leading zeros); anything else that isn't in brackets is a registered
+  // name, as RFC 3986 section 3.2.2 has it.
+  enum class host_type : std::uint8_t
+  {
+    none,
+    reg_name,
+    ipv4,
+    ipv6,
+    ipv_future
+  };
+
+  // The reasons a parse can fail, as reported by the try_parse methods.
+  enum class parse_error
+  {
+    none,
+    empty,
+    too_long,
+    invalid_scheme_character,
+    missing_scheme_separator,
+    empty_scheme,
+    missing_password,
+    unterminated_ip_literal,
+    unexpected_host_character,
+    invalid_port,
+    port_out_of_range,
+    non_hierarchical_base,
+    invalid_ip_literal
+  };
+
+  static constexpr char const *describe(parse_error error) noexcept
+  {
+    switch (error)
+    {
+    case parse_error::none:
+      return "No error.";
+    case parse_error::empty:
+      return "URIs cannot be of zero length.";
+    case parse_error::too_long:
+      return "URIs cannot be longer than 4GiB.";
+    case parse_error::invalid_scheme_character:
+      return "Invalid character found in the scheme component.";
+    case parse_error::missing_scheme_separator:
+      return "End of URI found while parsing the scheme.";
+    case parse_error::empty_scheme:
+      return "Scheme component cannot be zero-length.";
+    case parse_error::missing_password:
+      return "Username must be followed by a password.";
+    case parse_error::unterminated_ip_literal:
+      return "End of content component encountered while parsing the host component.";
+    case parse_error::unexpected_host_character:
+      return "Unexpected character following the host component.";
+    case parse_error::invalid_port:
+      return "Invalid character while parsing the port.";
+    case parse_error::port_out_of_range:
+      return "Port is out of range.";
+    case parse_error::non_hierarchical_base:
+      return "Only a fragment can be resolved against a non-hierarchical base URI.";
+    case parse_error::invalid_ip_literal:
+      return "Invalid IPv6 or IPvFuture address in the host component.";
+    }
+    return "Unknown error.";
+  };
+
+  // The outcome of one of the try_parse methods: either the parsed value, or
+  // the error that stopped the parse along with the offset of the character in
+  // the supplied text that it stopped on.
+  template <typename T>
+  class parse_result
+  {
+  public:
+
+    constexpr parse_result(T value) :
+      m_value(std::move(value)),
+      m_error(parse_error::none),
+      m_error_offset(0)
+    { };
+
+    constexpr parse_result(parse_error error, size_t error_offset) noexcept :
+      m_error(error),
+      m_error_offset(error_offset)
+    { };
+
+    constexpr explicit operator bool() const noexcept
+    {
+      return has_value();
+    };
+
+    constexpr bool has_value() const noexcept
+    {
+      return m_error == parse_error::none;
+    };
+
+    // Throws a std::invalid_argument describing the error if the parse failed.
+    constexpr T const &value() const
+    {
+      if (!has_value())
+      {
+        throw std::invalid_argument(describe(m_error));
+      }
+      return *m_value;
+    };
+
+    constexpr T const &operator*() const
+    {
+      return *m_value;
+    };
+
+    constexpr T const *operator->() const
+    {
+      return &*m_value;
+    };
+
+    constexpr parse_error error() const noexcept
+    {
+      return m_error;
+    };
+
+    constexpr size_t error_offset() const noexcept
+    {
+      return m_error_offset;
+    };
+
+  private:
+
+    std::optional<T> m_value;
+    parse_error m_error;
+    size_t m_error_offset;
+  };
+
+  // Where a single key and value lie within the query component.
+  struct query_entry
+  {
+    std::uint32_t key_offset;
+    std::uint32_t key_length;
+    std::uint32_t value_offset;
+    std::uint32_t value_length;
+  };
+
+  // A read-only view of the parameters in a query component, in the order
+  // they appear. Keys may repeat (as in "?id=1&id=2"); the lookups that return
+  // a single value return the first one. Keys and values are views into the
+  // query component of the URI that produced the dictionary, and are only
+  // valid for as long as it is.
+  class query_dictionary
+  {
+  public:
+
+    using value_type = std::pair<std::string_view, std::string_view>;
+
+    class const_iterator
+    {
+    public:
+
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = query_dictionary::value_type;
+      using difference_type = std::ptrdiff_t;
+      using pointer = value_type const *;
+      using reference = value_type const &;
+
+      const_iterator() noexcept :
+        m_entry(nullptr)
+      { };
+
+      reference operator*() const noexcept
+      {
+        return m_current;
+      };
+
+      pointer operator->() const noexcept
+      {
+        return &m_current;
+      };
+
+      const_iterator &operator++() noexcept
+      {
+        ++m_entry;
+        load();
+        return *this;
+      };
+
+      const_iterator operator++(int) noexcept
+      {
+        const_iterator previous(*this);
+        ++*this;
+        return previous;
+      };
+
+      bool operator==(const_iterator const &other) const noexcept
+      {
+        return m_entry == other.m_entry;
+      };
+
+      bool operator!=(const_iterator const &other) const noexcept
+      {
+        return m_entry != other.m_entry;
+      };
+
+    private:
+
+      friend class query_dictionary;
+
+      const_iterator(std::string_view query, query_entry const *entry, query_entry const *end) noexcept :
+        m_query(query),
+        m_entry(entry),
+        m_end(end)
+      {
+        load();
+      };
+
+      void load() noexcept
+      {
+        if (m_entry != m_end)
+        {
+          m_current.first = m_query.substr(m_entry->key_offset, m_entry->key_length);
+          m_current.second = m_query.substr(m_entry->value_offset, m_entry->value_length);
+        }
+      };
+
+      std::string_view m_query;
+      query_entry const *m_entry;
+      query_entry const *m_end;
+      value_type m_current;
+    };
+
+    const_iterator begin() const noexcept
+    {
+      return const_iterator(m_query, m_entries, (m_entries + m_size));
+    };
+
+    const_iterator end() const noexcept
+    {
+      return const_iterator(m_query, (m_entries + m_size), (m_entries + m_size));
+    };
+
+    size_t size() const noexcept
+    {
+      return m_size;
+    };
+
+    bool empty() const noexcept
+    {
+      return m_size == 0;
+    };
+
+    // Returns the first parameter with the given key, or end() if there isn't
+    // one.
+    const_iterator find(std::string_view key) const noexcept
+    {
+      const_iterator parameter = begin();
+      while ((parameter != end()) && (parameter->first != key))
+      {
+        ++parameter;
+      }
+      return parameter;
+    };
+
+    size_t count(std::string_view key) const noexcept
+    {
+      size_t matches = 0;
+      for (value_type const &parameter : *this)
+      {
+        matches += (parameter.first == key) ? 1 : 0;
+      }
+      return matches;
+    };
+
+    bool contains(std::string_view key) const noexcept
+    {
+      return find(key) != end();
+    };
+
+    // Returns the first value for the given key, or an empty view if the key
+    // isn't present.
+    std::string_view operator[](std::string_view key) const noexcept
+    {
+      const_iterator const parameter = find(key);
+      return (parameter != end()) ? parameter->second : std::string_view();
+    };
+
+    // Finds the first parameter whose key, once percent-decoded, is key, and
+    // returns its value decoded; '+' decodes to a space, as in HTML form
+    // submissions. Only the keys and values that hold a '%' or '+' are
+    // decoded, and only as they're reached.
+    std::optional<std::string> find_decoded(std::string_view key) const
+    {
+      std::string decoded_key;
+      for (value_type const &parameter : *this)
+      {
+        bool matches = false;
+        if (needs_query_decoding(parameter.first))
+        {
+          decode_component(parameter.first, decoded_key, true);
+          matches = (decoded_key == key);
+        }
+        else
+        {
+          matches = (parameter.first == key);
+        }
+
+        if (matches)
+        {
+          return decode_component(parameter.second, true);
+        }
+      }
+      return std::nullopt;
+    };
+
+    // Returns the first value for the given key, throwing std::out_of_range if
+    // the key isn't present.
+    std::string_view at(std::string_view key) const
+    {
+      const_iterator const parameter = find(key);
+      if (parameter == end())
+      {
+        throw std::out_of_range("The key is not present in the query string.");
+      }
+      return parameter->second;
+    };
+
+  private:
+
+    friend class uri;
+
+    query_dictionary(std::string_view query, query_entry const *entries, size_t size) noexcept :
+      m_query(query),
+      m_entries(entries),
+      m_size(size)
+    { };
+
+    std::string_view m_query;
+    query_entry const *m_entries;
+    size_t m_size;
+  };
+
+  /* The segments of a hierarchical URI's path, split at each '/': "a/b/"
+   * has the segments "a", "b" and "". The '/' that roots a path isn't a
+   * separator, so "/" and "" have none. Iterating in either direction finds
+   * each segment as it's reached, without allocating, while the count and
+   * last segment were recorded when the path was parsed. Segments are views
+   * into the path of the URI that produced the range, and are only valid for
+   * as long as it is unchanged.
+   */
+  class path_segment_range
+  {
+  public:
+
+    class const_iterator
+    {
+    public:
+
+      using iterator_category = std::bidirectional_iterator_tag;
+      using value_type = std::string_view;
+      using difference_type = std::ptrdiff_t;
+      using pointer = std::string_view const *;
+      using reference = std::string_view const &;
+
+      constexpr const_iterator() noexcept :
+        m_path(),
+        m_start(1),
+        m_current()
+      { };
+
+      constexpr reference operator*() const noexcept
+      {
+        return m_current;
+      };
+
+      constexpr pointer operator->() const noexcept
+      {
+        return &m_current;
+      };
+
+      constexpr const_iterator &operator++() noexcept
+      {
+        m_start += m_current.length() + 1;
+        load();
+        return *this;
+      };
+
+      constexpr const_iterator operator++(int) noexcept
+      {
+        const_iterator previous(*this);
+        ++*this;
+        return previous;
+      };
+
+      constexpr const_iterator &operator--() noexcept
+      {
+        size_t const end = m_start - 1;
+        size_t const slash = (end == 0) ? std::string_view::npos : m_path.rfind('/', (end - 1));
+        m_start = (slash == std::string_view::npos) ? 0 : (slash + 1);
+        m_current = m_path.substr(m_start, (end - m_start));
+        return *this;
+      };
+
+      constexpr const_iterator operator--(int) noexcept
+      {
+        const_iterator previous(*this);
+        --*this;
+        return previous;
+      };
+
+      constexpr bool operator==(const_iterator const &other) const noexcept
+      {
+        return m_start == other.m_start;
+      };
+
+      constexpr bool operator!=(const_iterator const &other) const noexcept
+      {
+        return m_start != other.m_start;
+      };
+
+    private:
+
+      friend class path_segment_range;
+
+      // start is where the segment begins in the path; one past the end of
+      // the path is the end of the range.
+      constexpr const_iterator(std::string_view path, size_t start) noexcept :
+        m_path(path),
+        m_start(start),
+        m_current()
+      {
+        load();
+      };
+
+      constexpr void load() noexcept
+      {
+        if (m_start <= m_path.length())
+        {
+          size_t const slash = m_path.find('/', m_start);
+          m_current = m_path.substr(m_start, (((slash == std::string_view::npos) ? m_path.length() : slash) - m_start));
+        }
+      };
+
+      std::string_view m_path;
+      size_t m_start;
+      std::string_view m_current;
+    };
+
+    constexpr const_iterator begin() const noexcept
+    {
+      return const_iterator(m_path, (m_path.empty() ? 1 : 0));
+    };
+
+    constexpr const_iterator end() const noexcept
+    {
+      return const_iterator(m_path, (m_path.length() + 1));
+    };
+
+    constexpr size_t size() const noexcept
+    {
+      return m_size;
+    };
+
+    constexpr bool empty() const noexcept
+    {
+      return m_size == 0;
+    };
+
+    constexpr std::string_view front() const noexcept
+    {
+      return *begin();
+    };
+
+    // The last segment; empty if the path ends in '/', or has no segments.
+    constexpr std::string_view back() const noexcept
+    {
+      return m_path.substr(m_last);
+    };
+
+  private:
+
+    friend class uri;
+    friend class uri_view;
+
+    constexpr path_segment_range(std::string_view path, size_t size, size_t last) noexcept :
+      m_path(path),
+      m_size(size),
+      m_last(last)
+    { };
+
+    std::string_view m_path;
+    size_t m_size;
+    size_t m_last;
+  };
+
+  // A uri's buffers come from a polymorphic allocator, so that a batch of
+  // URIs which are discarded together can be allocated from one arena (such
+  // as a std::pmr::monotonic_buffer_resource) and released at once. The
+  // constructors taking std::allocator_arg use the given allocator; the
+  // others use the default memory resource. A std::pmr container of uris
+  // passes its own allocator on to them.
+  using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+  uri(char const *uri_text, scheme_category category = scheme_category::Hierarchical,
+      query_argument_separator separator = query_argument_separator::ampersand) :
+    m_components(),
+    m_separator(separator)
+  {
+    setup(uri_text, category);
+  };
+
+  uri(std::string const &uri_text, scheme_category category = scheme_category::Hierarchical,
+      query_argument_separator separator = query_argument_separator::ampersand) :
+    m_components(),
+    m_separator(separator)
+  {
+    setup(uri_text, category);
+  };
+
+  uri(std::map<component, std::string> const &components,
+      scheme_category category,
+      bool rooted_path,
+      query_argument_separator separator = query_argument_separator::ampersand) :
+    m_components(),
+    m_separator(separator)
+  {
+    component_parts parts{};
+    m_components.path_is_rooted = rooted_path;
+
+    if (components.count(component::Scheme))
+    {
+      if (components.at(component::Scheme).length() == 0)
+      {
+	throw std::invalid_argument("Scheme cannot be empty.");
+      }
+      parts[static_cast<size_t>(component::Scheme)] = components.at(component::Scheme);
+      m_components.scheme = identify_scheme(components.at(component::Scheme));
+    }
+    else
+    {
+      throw std::invalid_argument("A URI must have a scheme.");
+    }
+
+    // Without any text to look at, an unknown scheme is taken to be
+    // hierarchical unless it's given content.
+    if (category == scheme_category::Automatic)
+    {
+      category = category_of(m_components.scheme, !components.count(component::Content));
+    }
+    m_components.category = category;
+
+    if (category == scheme_category::Hierarchical)
+    {
+      if (components.count(component::Content))
+      {
+	throw std::invalid_argument("The content component is only for use in non-hierarchical URIs.");
+      }
+
+      bool has_username = components.count(component::Username);
+      bool has_password = components.count(component::Password);
+      if (has_username && has_password)
+      {
+	parts[static_cast<size_t>(component::Username)] = components.at(component::Username);
+	parts[static_cast<size_t>(component::Password)] = components.at(component::Password);
+      }
+      else if ((has_username && !has_password) || (!has_username && has_password))
+      {
+	throw std::invalid_argument("If a username or password is supplied, both must be provided.");
+      }
+
+      if (components.count(component::Host))
+      {
+	parts[static_cast<size_t>(component::Host)] = components.at(component::Host);
+	m_components.host = host_type_of(components.at(component::Host));
+      }
+
+      if (components.count(component::Port))
+      {
+	m_components.port = port_from_string(components.at(component::Port));
+      }
+
+      m_components.has_authority = has_username || components.count(component::Host)
+        || components.count(component::Port);
+
+      if (components.count(component::Path))
+      {
+	parts[static_cast<size_t>(component::Path)] = components.at(component::Path);
+      }
+      else
+      {
+	throw std::invalid_argument("A path is required on a hierarchical URI, even an empty path.");
+      }
+    }
+    else
+    {
+      if (components.count(component::Username)
+	  || components.count(component::Password)
+	  || components.count(component::Host)
+	  || components.count(component::Port)
+	  || components.count(component::Path))
+      {
+	throw std::invalid_argument("None of the hierarchical components are allowed in a non-hierarchical URI.");
+      }
+
+      if (components.count(component::Content))
+      {
+	parts[static_cast<size_t>(component::Content)] = components.at(component::Content);
+      }
+      else
+      {
+	throw std::invalid_argument("Content is a required component for a non-hierarchical URI, even an empty string.");
+      }
+    }
+
+    if (components.count(component::Query))
+    {
+      parts[static_cast<size_t>(component::Query)] = components.at(component::Query);
+    }
+
+    if (components.count(component::Fragment))
+    {
+      parts[static_cast<size_t>(component::Fragment)] = components.at(component::Fragment);
+    }
+
+    serialize(parts, m_components, m_text);
+  }
+
+  uri(uri const &other, std::map<component, std::string> const &replacements) :
+    m_components(other.m_components),
+    m_separator(other.m_separator)
+  {
+    m_components.normalized = false;
+    component_parts parts;
+    for (size_t index = 0; index < parts.size(); ++index)
+    {
+      auto const replacement = replacements.find(static_cast<component>(index));
+      parts[index] = (replacement != replacements.end())
+        ? std::string_view(replacement->second) : other.get_component(static_cast<component>(index));
+    }
+
+    if (replacements.count(component::Scheme))
+    {
+      m_components.scheme = identify_scheme(replacements.at(component::Scheme));
+    }
+
+    if (replacements.count(component::Port))
+    {
+      m_components.port = port_from_string(replacements.at(component::Port));
+    }
+
+    if (replacements.count(component::Host))
+    {
+      m_components.host = host_type_of(replacements.at(component::Host));
+    }
+
+    if (replacements.count(component::Host) || replacements.count(component::Port))
+    {
+      m_components.has_authority = true;
+    }
+
+    serialize(parts, m_components, m_text);
+  }
+
+  uri(std::allocator_arg_t, allocator_type const &allocator, char const *uri_text,
+      scheme_category category = scheme_category::Hierarchical,
+      query_argument_separator separator = query_argument_separator::ampersand) :
+    m_text(allocator),
+    m_components(),
+    m_query_index(allocator),
+    m_separator(separator)
+  {
+    setup(uri_text, category);
+  };
+
+  uri(std::allocator_arg_t, allocator_type const &allocator, std::string const &uri_text,
+      scheme_category category = scheme_category::Hierarchical,
+      query_argument_separator separator = query_argument_separator::ampersand) :
+    m_text(allocator),
+    m_components(),
+    m_query_index(allocator),
+    m_separator(separator)
+  {
+    setup(uri_text, category);
+  };
+
+  // Copies and moves are member-wise. Move construction takes over the
+  // original's memory and never throws, so containers of uris move rather
+  // than copy them when they grow. As with the standard pmr types, a copy
+  // uses the default memory resource rather than that of the original, and
+  // assignment keeps the allocator of the target; moving a uri onto one that
+  // uses another memory resource copies the text, and so may throw
+  // std::bad_alloc.
+  uri(uri const &other) = default;
+  uri(uri &&other) noexcept = default;
+  uri &operator=(uri const &other) = default;
+  uri &operator=(uri &&other) = default;
+
+  uri(std::allocator_arg_t, allocator_type const &allocator, uri const &other) :
+    m_text(other.m_text, allocator),
+    m_components(other.m_components),
+    m_query_index(other.m_query_index, allocator),
+    m_query_indexed(other.m_query_indexed),
+    m_separator(other.m_separator)
+  { };
+
+  // Only avoids a copy when other uses the same memory resource.
+  uri(std::allocator_arg_t, allocator_type const &allocator, uri &&other) :
+    m_text(std::move(other.m_text), allocator),
+    m_components(other.m_components),
+    m_query_index(std::move(other.m_query_index), allocator),
+    m_query_indexed(other.m_query_indexed),
+    m_separator(other.m_separator)
+  { };
+
+  // Copies the components of a parsed view into a new, owning URI.
+  explicit uri(uri_view const &view);
+  uri(std::allocator_arg_t, allocator_type const &allocator, uri_view const &view);
+
+  // Parses a URI without throwing on malformed input; rather than throwing, the
+  // result carries the error and where in uri_text the parse stopped. Copying
+  // the text may still throw std::bad_alloc; uri_view::try_parse never throws.
+  static parse_result<uri> try_parse(std::string_view uri_text,
+                                     scheme_category category = scheme_category::Hierarchical,
+                                     query_argument_separator separator = query_argument_separator::ampersand,
+                                     allocator_type const &allocator = {})
+  {
+    component_table table;
+    table.category = category;
+    size_t cursor;
+    parse_error const error = parse_components(uri_text, table, cursor);
+    if (error != parse_error::none)
+    {
+      return parse_result<uri>(error, cursor);
+    }
+
+    uri result(separator, allocator);
+    result.assign(uri_text, table);
+    return parse_result<uri>(std::move(result));
+  };
+
+  ~uri() = default;
+
+  allocator_type get_allocator() const noexcept
+  {
+    return m_text.get_allocator();
+  };
+
+  std::string_view get_scheme() const
+  {
+    return get_component(component::Scheme);
+  };
+
+  scheme_category get_scheme_category() const
+  {
+    return m_components.category;
+  };
+
+  // Which of the well-known schemes this is, if any, recognized while
+  // parsing; comparing this is cheaper than comparing get_scheme().
+  known_scheme get_known_scheme() const noexcept
+  {
+    return m_components.scheme;
+  };
+
+  std::string_view get_content() const
+  {
+    if (m_components.category != scheme_category::NonHierarchical)
+    {
+      throw std::domain_error("The content component is only valid for non-hierarchical URIs.");
+    }
+    return get_component(component::Content);
+  };
+
+  std::string_view get_username() const
+  {
+    if (m_components.category != scheme_category::Hierarchical)
+    {
+      throw std::domain_error("The username component is only valid for hierarchical URIs.");
+    }
+    return get_component(component::Username);
+  };
+
+  std::string_view get_password() const
+  {
+    if (m_components.category != scheme_category::Hierarchical)
+    {
+      throw std::domain_error("The password component is only valid for hierarchical URIs.");
+    }
+    return get_component(component::Password);
+  };
+
+  std::string_view get_host() const
+  {
+    if (m_components.category != scheme_category::Hierarchical)
+    {
+      throw std::domain_error("The host component is only valid for hierarchical URIs.");
+    }
+    return get_component(component::Host);
+  };
+
+  host_type get_host_type() const
+  {
+    if (m_components.category != scheme_category::Hierarchical)
+    {
+      throw std::domain_error("The host component is only valid for hierarchical URIs.");
+    }
+    return m_components.host;
+  };
+
+  // The binary forms of an IP address host, in network byte order; empty
+  // when the host isn't an address of that kind. The host was validated when
+  // the URI was parsed, so these only decode it.
+  std::optional<std::array<std::uint8_t, 4>> get_ipv4_address() const noexcept
+  {
+    return ipv4_address(get_component(component::Host), m_components.host);
+  };
+
+  std::optional<std::array<std::uint8_t, 16>> get_ipv6_address() const noexcept
+  {
+    return ipv6_address(get_component(component::Host), m_components.host);
+  };
+
+  // The zone ID of an IPv6 host, such as "eth0" in "[fe80::1%25eth0]", still
+  // percent-encoded; empty if there's none.
+  std::string_view get_zone_id() const noexcept
+  {
+    return zone_id(get_component(component::Host), m_components.host);
+  };
+
+  unsigned long get_port() const
+  {
+    if (m_components.category != scheme_category::Hierarchical)
+    {
+      throw std::domain_error("The port component is only valid for hierarchical URIs.");
+    }
+    return m_components.port;
+  };
+
+  std::string_view get_path() const
+  {
+    if (m_components.category != scheme_category::Hierarchical)
+    {
+      throw std::domain_error("The path component is only valid for hierarchical URIs.");
+    }
+    return get_component(component::Path);
+  };
+
+  // The path split into segments; the count and the last segment are known
+  // without splitting it.
+  path_segment_range get_path_segments() const
+  {
+    return path_segment_range(get_path(), m_components.path_segments, m_components.last_segment);
+  };
+
+  std::string_view get_query() const
+  {
+    return get_component(component::Query);
+  };
+
+  // The query is only split into parameters on the first call to either of
+  // these; URIs whose query is never inspected don't pay for it.
+  query_dictionary get_query_dictionary() const
+  {
+    if (!m_query_indexed)
+    {
+      init_query_dictionary();
+    }
+    return query_dictionary(get_query(), m_query_index.data(), m_query_index.size());
+  };
+
+  std::optional<std::string_view> find_query_param(std::string_view key) const
+  {
+    query_dictionary const dictionary = get_query_dictionary();
+    query_dictionary::const_iterator const parameter = dictionary.find(key);
+    if (parameter == dictionary.end())
+    {
+      return std::nullopt;
+    }
+    return parameter->second;
+  };
+
+  // As find_query_param, but matching and returning percent-decoded text; see
+  // query_dictionary::find_decoded.
+  std::optional<std::string> find_decoded_query_param(std::string_view key) const
+  {
+    return get_query_dictionary().find_decoded(key);
+  };
+
+  std::string_view get_fragment() const
+  {
+    return get_component(component::Fragment);
+  };
+
+  /* The setters below change one component in place: only the bytes of that
+   * component are rewritten, and the components after it are moved along,
+   * rather than the whole URI being rebuilt. Each validates only the
+   * component it changes, throwing std::invalid_argument if the new value
+   * couldn't be parsed back out of the URI; the hierarchical components
+   * throw std::domain_error on a non-hierarchical URI, as their getters do.
+   * Any of them clears is_normalized(), and views of the URI's text or its
+   * query dictionary are invalidated.
+   */
+  void set_host(std::string_view host)
+  {
+    require_hierarchical("host");
+    component_table table{};
+    size_t cursor = 0;
+    parse_error error = parse_host(host, cursor, table);
+    if ((error == parse_error::none)
+        && ((cursor != host.length()) || (host.find_first_of("/?#@") != std::string_view::npos)))
+    {
+      error = parse_error::unexpected_host_character;
+    }
+    if (error != parse_error::none)
+    {
+      throw std::invalid_argument(describe(error));
+    }
+
+    if (!m_components.has_authority)
+    {
+      rebuild(component::Host, host);
+    }
+    else
+    {
+      component_span const span = m_components.spans[static_cast<size_t>(component::Host)];
+      splice(component::Host, span.offset, (span.offset + span.length), { host });
+      set_span(m_components, component::Host, span.offset, (span.offset + host.length()));
+    }
+    m_components.host = table.host;
+  };
+
+  // A port of 0 removes the port.
+  void set_port(std::uint16_t port)
+  {
+    require_hierarchical("port");
+    if (!m_components.has_authority)
+    {
+      // There's no port to remove, and only a port needs an authority added.
+      if (port != 0)
+      {
+        m_components.port = port;
+        rebuild(component::Port, std::string_view());
+      }
+      return;
+    }
+
+    char digits[6] = { ':' };
+    size_t const digit_count = (port == 0) ? 0 : count_digits(port);
+    for (size_t index = digit_count, remaining = port; index > 0; remaining /= 10)
+    {
+      digits[index--] = static_cast<char>('0' + (remaining % 10));
+    }
+
+    // The ':' before the port goes and comes with it.
+    component_span const host = m_components.spans[static_cast<size_t>(component::Host)];
+    size_t const begin = host.offset + host.length;
+    size_t const end = (m_components.port == 0) ? begin
+      : (m_components.spans[static_cast<size_t>(component::Port)].offset
+         + m_components.spans[static_cast<size_t>(component::Port)].length);
+    splice(component::Port, begin, end, { std::string_view(digits, ((port == 0) ? 0 : (digit_count + 1))) });
+    m_components.spans[static_cast<size_t>(component::Port)] = (port == 0) ? component_span{ 0, 0 }
+      : component_span{ static_cast<std::uint32_t>(begin + 1), static_cast<std::uint32_t>(digit_count) };
+    m_components.port = port;
+  };
+
+  // The path is given as get_path() returns it, without the '/' that roots
+  // it; whether it's rooted is kept, except that a path following an
+  // authority is always rooted.
+  void set_path(std::string_view path)
+  {
+    require_hierarchical("path");
+    if (path.find_first_of("?#") != std::string_view::npos)
+    {
+      throw std::invalid_argument("A path cannot contain '?' or '#'.");
+    }
+    if (!m_components.has_authority && !m_components.path_is_rooted && (path.substr(0, 2) == "//"))
+    {
+      throw std::invalid_argument("A path cannot start with \"//\" unless the URI has an authority.");
+    }
+
+    component_span const span = m_components.spans[static_cast<size_t>(component::Path)];
+    size_t const begin = span.offset - (m_components.path_is_rooted ? 1 : 0);
+    bool const rooted = m_components.path_is_rooted || (m_components.has_authority && !path.empty());
+    splice(component::Path, begin, (span.offset + span.length), { (rooted ? "/" : ""), path });
+    set_span(m_components, component::Path, (begin + (rooted ? 1 : 0)), (begin + (rooted ? 1 : 0) + path.length()));
+    m_components.path_is_rooted = rooted;
+    index_path(path, m_components);
+  };
+
+  /* Adds a segment to the end of the path. A trailing empty segment, as left
+   * by a path ending in '/', is filled in rather than kept, so appending "c"
+   * to "a/b/" gives "a/b/c". The segment is taken as it's to appear in the
+   * path, so it should already be percent-encoded, and may not hold '/', '?'
+   * or '#'.
+   */
+  void append_segment(std::string_view segment)
+  {
+    require_hierarchical("path");
+    if (segment.find_first_of("/?#") != std::string_view::npos)
+    {
+      throw std::invalid_argument("A path segment cannot contain '/', '?' or '#'.");
+    }
+
+    component_span const span = m_components.spans[static_cast<size_t>(component::Path)];
+    if (span.length == 0)
+    {
+      set_path(segment);
+      return;
+    }
+
+    size_t const end = span.offset + span.length;
+    bool const fill = (m_components.last_segment == span.length);
+    splice(component::Path, end, end, { (fill ? "" : "/"), segment });
+    set_span(m_components, component::Path, span.offset, (end + (fill ? 0 : 1) + segment.length()));
+    if (!fill)
+    {
+      ++m_components.path_segments;
+      m_components.last_segment = span.length + 1;
+    }
+  };
+
+  // Removes the last segment of the path and the '/' before it, so "a/b"
+  // becomes "a" and "a/" becomes "a"; a rooted path keeps its root. Returns
+  // false if the path has no segments to remove.
+  bool pop_segment()
+  {
+    require_hierarchical("path");
+    if (m_components.path_segments == 0)
+    {
+      return false;
+    }
+
+    component_span const span = m_components.spans[static_cast<size_t>(component::Path)];
+    size_t const last = m_components.last_segment;
+    size_t const begin = span.offset + ((last == 0) ? 0 : (last - 1));
+    splice(component::Path, begin, (span.offset + span.length), {});
+    set_span(m_components, component::Path, span.offset, begin);
+    size_t const slash = get_component(component::Path).rfind('/');
+    --m_components.path_segments;
+    m_components.last_segment = (slash == std::string_view::npos) ? 0 : static_cast<std::uint32_t>(slash + 1);
+    return true;
+  };
+
+  /* Sets the value of the first query parameter with the given key, or adds
+   * the parameter to the end of the query if there's none; any later
+   * parameters with the same key are left as they are. The key and value
+   * are taken as they're to appear in the query, so they should already be
+   * percent-encoded (see encode_component); neither may hold '#' or the
+   * URI's query separator, and the key may not hold '='.
+   */
+  void set_query_param(std::string_view key, std::string_view value)
+  {
+    char const separator = (m_separator == query_argument_separator::ampersand) ? '&' : ';';
+    char const disallowed[] = { '#', separator, '\0' };
+    if ((key.find_first_of(disallowed) != std::string_view::npos) || (key.find('=') != std::string_view::npos)
+        || (value.find_first_of(disallowed) != std::string_view::npos))
+    {
+      throw std::invalid_argument("A query parameter cannot contain '#' or the query separator, "
+                                  "nor its key an '='.");
+    }
+
+    component_span const span = m_components.spans[static_cast<size_t>(component::Query)];
+    std::string_view const query = get_component(component::Query);
+    size_t carat = 0;
+    query_entry entry;
+    while (!query.empty() && next_query_parameter(query, m_separator, carat, entry))
+    {
+      if (query.substr(entry.key_offset, entry.key_length) == key)
+      {
+        // A parameter without an '=' gains one.
+        size_t const value_end = span.offset + entry.value_offset + entry.value_length;
+        size_t const key_end = span.offset + entry.key_offset + entry.key_length;
+        size_t const old_length = value_end - key_end;
+        splice(component::Query, key_end, value_end, { "=", value });
+        set_span(m_components, component::Query, span.offset, (span.offset + span.length + value.length() + 1
+                                                               - old_length));
+        return;
+      }
+    }
+
+    if (query.empty())
+    {
+      component_span const fragment = m_components.spans[static_cast<size_t>(component::Fragment)];
+      size_t const begin = (fragment.offset != 0) ? (fragment.offset - 1) : m_text.length();
+      splice(component::Query, begin, begin, { "?", key, "=", value });
+      set_span(m_components, component::Query, (begin + 1), (begin + 2 + key.length() + value.length()));
+    }
+    else
+    {
+      size_t const end = span.offset + span.length;
+      splice(component::Query, end, end, { std::string_view(&separator, 1), key, "=", value });
+      set_span(m_components, component::Query, span.offset, (end + key.length() + value.length() + 2));
+    }
+  };
+
+  // Removes every query parameter with the given key, returning how many
+  // there were; the '?' goes too if none are left.
+  size_t remove_query_param(std::string_view key)
+  {
+    char const separator = (m_separator == query_argument_separator::ampersand) ? '&' : ';';
+    component_span const span = m_components.spans[static_cast<size_t>(component::Query)];
+    std::string_view const query = get_component(component::Query);
+    if (query.empty())
+    {
+      return 0;
+    }
+
+    // The kept parameters are moved down over the removed ones; the write
+    // position never passes the parameter being read.
+    size_t removed = 0;
+    size_t write = span.offset;
+    size_t carat = 0;
+    query_entry entry;
+    while (next_query_parameter(query, m_separator, carat, entry))
+    {
+      if (query.substr(entry.key_offset, entry.key_length) == key)
+      {
+        ++removed;
+        continue;
+      }
+      if (write != span.offset)
+      {
+        m_text[write++] = separator;
+      }
+      size_t const length = entry.value_offset + entry.value_length - entry.key_offset;
+      std::memmove(&m_text[write], &m_text[span.offset + entry.key_offset], length);
+      write += length;
+    }
+
+    if (removed == 0)
+    {
+      return 0;
+    }
+    size_t const end = span.offset + span.length;
+    if (write == span.offset)
+    {
+      splice(component::Query, (span.offset - 1), end, {});
+      m_components.spans[static_cast<size_t>(component::Query)] = { 0, 0 };
+    }
+    else
+    {
+      splice(component::Query, write, end, {});
+      set_span(m_components, component::Query, span.offset, write);
+    }
+    return removed;
+  };
+
+  // The URI is stored in its normalized form, so this is a plain copy.
+  std::string to_string() const
+  {
+    return std::string(m_text);
+  };
+
+  // The length of the string to_string() returns.
+  size_t serialized_size() const noexcept
+  {
+    return m_text.length();
+  };
+
+  // Writes the URI into out, replacing its contents; a string reused across
+  // calls is only reallocated when a URI outgrows it.
+  void to_string(std::string &out) const
+  {
+    out.assign(m_text.data(), m_text.length());
+  };
+
+  // Writes the URI to an output iterator (such as a char * into a buffer of
+  // at least serialized_size() characters), returning the iterator past the
+  // last character written.
+  template <typename OutputIterator>
+  OutputIterator to_string(OutputIterator out) const
+  {
+    return std::copy(m_text.begin(), m_text.end(), out);
+  };
+
+  // A view of the URI's text, valid until the uri is next modified.
+  std::string_view to_string_view() const noexcept
+  {
+    return m_text;
+  };
+
+  /* Applies the syntax- and scheme-based normalizations of RFC 3986 (section
+   * 6.2.2 and 6.2.3), so that URIs which differ only in ways the RFC deems
+   * equivalent end up with identical text:
+   *  - the scheme and host are lowercased;
+   *  - percent-encodings of unreserved characters are decoded, and the hex
+   *    digits of any others are uppercased;
+   *  - "." and ".." segments are removed from rooted paths;
+   *  - the default port of http, https, ws, wss and ftp is dropped, and an
+   *    empty path following an authority for those schemes becomes "/".
+   * A URI that is already normal is left untouched without allocating.
+   */
+  void normalize()
+  {
+    if (m_components.normalized)
+    {
+      return;
+    }
+
+    if (needs_normalization())
+    {
+      std::string scratch;
+      scratch.reserve(m_text.length() + 1);
+      component_parts parts;
+      std::array<std::pair<size_t, size_t>, 9> ranges{};
+
+      // Each component is normalized into the scratch string, with the path
+      // last so that its dot segments can be removed in place at the end.
+      for (component which : { component::Scheme, component::Username, component::Password,
+                               component::Host, component::Content, component::Query,
+                               component::Fragment, component::Path })
+      {
+        bool const lowercase = (which == component::Scheme) || (which == component::Host);
+        size_t const begin = scratch.length();
+        if ((which == component::Path) && m_components.path_is_rooted)
+        {
+          scratch.push_back('/');
+        }
+        append_normalized(scratch, get_component(which), lowercase);
+        if ((which == component::Path) && m_components.path_is_rooted)
+        {
+          scratch.resize(begin + remove_dot_segments((scratch.data() + begin), (scratch.length() - begin)));
+          ranges[static_cast<size_t>(which)] = { (begin + 1), (scratch.length() - begin - 1) };
+        }
+        else
+        {
+          ranges[static_cast<size_t>(which)] = { begin, (scratch.length() - begin) };
+        }
+      }
+
+      for (size_t index = 0; index < parts.size(); ++index)
+      {
+        parts[index] = std::string_view(scratch).substr(ranges[index].first, ranges[index].second);
+      }
+
+      std::uint16_t const default_port = default_port_for(m_components.scheme);
+      if ((default_port != 0) && (m_components.category == scheme_category::Hierarchical)
+          && m_components.has_authority)
+      {
+        if (m_components.port == default_port)
+        {
+          m_components.port = 0;
+        }
+        m_components.path_is_rooted = true;
+      }
+
+      serialize(parts, m_components, m_text);
+      m_query_index.clear();
+      m_query_indexed = false;
+    }
+
+    m_components.normalized = true;
+  };
+
+  uri normalized() const
+  {
+    uri copy(*this);
+    copy.normalize();
+    return copy;
+  };
+
+  bool is_normalized() const noexcept
+  {
+    return m_components.normalized;
+  };
+
+  // Resolves a URI reference against this URI as its base, following RFC 3986
+  // section 5.2: against "http://a/b/c/d;p?q", "../g" resolves to
+  // "http://a/b/g" and "#s" to "http://a/b/c/d;p?q#s". Throws
+  // std::invalid_argument if the reference doesn't parse, or if this URI is
+  // non-hierarchical and the reference is more than a fragment. To resolve
+  // many references against one base, use a uri_resolver.
+  uri resolve(std::string_view reference) const
+  {
+    uri target(m_separator);
+    std::string path_buffer;
+    size_t cursor;
+    parse_error const error = resolve_reference(*this, reference, path_buffer,
+                                                target.m_text, target.m_components, cursor);
+    if (error != parse_error::none)
+    {
+      throw std::invalid_argument(describe_failure(error, reference));
+    }
+    return target;
+  };
+
+  /* Percent-decodes text (RFC 3986 section 2.1), replacing the contents of
+   * out; a '%' that isn't followed by two hex digits is kept as it is. With
+   * plus_as_space, '+' decodes to a space, as in the query strings of HTML
+   * form submissions. Runs of text without a '%' are found a block at a time
+   * and copied in bulk. text must not alias out.
+   */
+  static void decode_component(std::string_view text, std::string &out, bool plus_as_space = false)
+  {
+    out.resize(text.length());
+    out.resize(decode_into(text.data(), text.length(), out.data(), plus_as_space));
+  };
+
+  static std::string decode_component(std::string_view text, bool plus_as_space = false)
+  {
+    std::string decoded;
+    decode_component(text, decoded, plus_as_space);
+    return decoded;
+  };
+
+  // Decodes in place, returning the decoded length; decoding never lengthens
+  // the text.
+  static size_t decode_component_in_place(char *text, size_t length, bool plus_as_space = false) noexcept
+  {
+    return decode_into(text, length, text, plus_as_space);
+  };
+
+  /* Percent-encodes text for use as the given component, replacing the
+   * contents of out. Characters that RFC 3986 allows unencoded in that
+   * component are copied as they are, and everything else (including '%'
+   * itself) is encoded:
+   *  - Username and Host: unreserved characters and sub-delims;
+   *  - Password: those and ':';
+   *  - Path and Content: those, ':', '@' and '/';
+   *  - Fragment: those, '?' too;
+   *  - Query: as Fragment, less '&', ';', '=' and '+', since it's meant for a
+   *    single key or value rather than a whole query string.
+   * The scheme and port have no percent-encoding, so they're rejected with a
+   * std::invalid_argument.
+   */
+  static void encode_component(std::string_view text, component which, std::string &out)
+  {
+    if ((which == component::Scheme) || (which == component::Port))
+    {
+      throw std::invalid_argument("The scheme and port components can't be percent-encoded.");
+    }
+
+    static char const hex_digits[] = "0123456789ABCDEF";
+    out.clear();
+    out.reserve(text.length());
+    size_t cursor = 0;
+    while (cursor != text.length())
+    {
+      // Skip over unreserved characters in bulk, then over any others the
+      // component allows one at a time, and copy the whole run at once.
+      size_t run_end = uri_detail::skip_unreserved(text, cursor);
+      while ((run_end != text.length()) && may_appear_unencoded(text[run_end], which))
+      {
+        ++run_end;
+      }
+      out.append((text.data() + cursor), (run_end - cursor));
+      cursor = run_end;
+
+      if (cursor != text.length())
+      {
+        unsigned char const c = static_cast<unsigned char>(text[cursor++]);
+        char const escape[3] = { '%', hex_digits[c >> 4], hex_digits[c & 0xF] };
+        out.append(escape, 3);
+      }
+    }
+  };
+
+  static std::string encode_component(std::string_view text, component which)
+  {
+    std::string encoded;
+    encode_component(text, which, encoded);
+    return encoded;
+  };
+
+  // Component-wise comparison. Since a uri's text is a function of its
+  // components, this compares the text directly rather than component by
+  // component, and orders URIs as their to_string() forms would be ordered.
+  friend bool operator==(uri const &left, uri const &right) noexcept
+  {
+    return (left.m_components.category == right.m_components.category)
+      && (left.m_text == right.m_text);
+  };
+
+  friend std::strong_ordering operator<=>(uri const &left, uri const &right) noexcept
+  {
+    int const order = left.m_text.compare(right.m_text);
+    if (order != 0)
+    {
+      return (order < 0) ? std::strong_ordering::less : std::strong_ordering::greater;
+    }
+    return left.m_components.category <=> right.m_components.category;
+  };
+
+  // Hashes the same bytes operator== compares; this is what std::hash<uri>
+  // returns.
+  size_t hash() const noexcept
+  {
+    return static_cast<size_t>(uri_detail::hash_bytes(m_text.data(), m_text.length(),
+                                                      static_cast<std::uint64_t>(m_components.category)));
+  };
+
+  // Whether two URIs are equivalent under RFC 3986 normalization (see
+  // normalize()); a URI that isn't already normalized is compared through a
+  // normalized copy.
+  static bool equivalent(uri const &left, uri const &right)
+  {
+    if (left.is_normalized() && right.is_normalized())
+    {
+      return left == right;
+    }
+    return (left.is_normalized() ? left : left.normalized())
+      == (right.is_normalized() ? right : right.normalized());
+  };
+
+  // For keying unordered containers on equivalence rather than exact equality:
+  //   std::unordered_map<uri, T, uri::normalized_hash, uri::normalized_equal>
+  // Normalize keys before inserting them to avoid a copy on every hash.
+  struct normalized_hash
+  {
+    size_t operator()(uri const &key) const
+    {
+      return key.is_normalized() ? key.hash() : key.normalized().hash();
+    };
+  };
+
+  struct normalized_equal
+  {
+    bool operator()(uri const &left, uri const &right) const
+    {
+      return equivalent(left, right);
+    };
+  };
+
+private:
+
+  friend class uri_view;
+  friend class uri_resolver;
+  friend class uri_router;
+
+  // Only used by try_parse and resolve, which assign the components themselves.
+  explicit uri(query_argument_separator separator, allocator_type const &allocator = {}) :
+    m_text(allocator),
+    m_components(),
+    m_query_index(allocator),
+    m_separator(separator)
+  { };
+
+  // The location of a single component within a URI's text. Components that
+  // weren't present in the text are left zero-length.
+  struct component_span
+  {
+    std::uint32_t offset;
+    std::uint32_t length;
+  };
+
+  // Every component's span, indexed by the component enumeration, plus the
+  // handful of values that aren't simple spans of the text.
+  struct component_table
+  {
+    std::array<component_span, 9> spans;
+    std::uint16_t port;
+    scheme_category category;
+    known_scheme scheme;
+    host_type host;
+    bool path_is_rooted;
+    bool has_authority;
+    // The number of segments in the path (not counting the '/' that roots
+    // it), and where in the path the last of them starts.
+    std::uint32_t path_segments;
+    std::uint32_t last_segment;
+    // Set once normalize() has run, and cleared by anything that changes the
+    // components afterwards.
+    bool normalized;
+  };
+
+  // The text of each component, indexed by the component enumeration; the
+  // port is taken from the table rather than from here.
+  using component_parts = std::array<std::string_view, 9>;
+
+  static constexpr void set_span(component_table &table, component which,
+                                 size_t begin, size_t end) noexcept
+  {
+    table.spans[static_cast<size_t>(which)] =
+      { static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(end - begin) };
+  };
+
+  // Builds the message thrown by the throwing constructors for a failed parse.
+  static std::string describe_failure(parse_error error, std::string_view uri_text)
+  {
+    return std::string(describe(error)) + " Supplied URI was: \""
+      + std::string(uri_text) + "\".";
+  };
+
+  // Parses uri_text into a table of component offsets without copying any of
+  // it, walking the text once from front to back. Each of the parse_* methods
+  // below picks up at cursor, records its component in the table and leaves
+  // cursor on the first character it didn't consume; on failure they return
+  // the error and leave cursor on the offending character.
+  static constexpr parse_error parse_components(std::string_view uri_text, component_table &table,
+                                                size_t &cursor) noexcept
+  {
+    clear_components(table);
+    cursor = 0;
+
+    if (uri_text.empty())
+    {
+      return parse_error::empty;
+    }
+
+    if (uri_text.length() > UINT32_MAX)
+    {
+      return parse_error::too_long;
+    }
+
+    // Nearly every URI is http or https, so those (and ws and wss) are
+    // recognized from their first bytes, with their authority scanned once.
+    if ((table.category != scheme_category::NonHierarchical) && parse_web_prefix(uri_text, cursor, table))
+    {
+      return parse_web_uri(uri_text, cursor, table);
+    }
+
+    parse_error error = parse_scheme(uri_text, cursor, table);
+    if (error != parse_error::none)
+    {
+      return error;
+    }
+
+    if (table.category == scheme_category::Automatic)
+    {
+      table.category = category_of(table.scheme, uri_text.substr(cursor + 1, 1) == "/");
+    }
+
+    // After calling parse_scheme, uri_text[cursor] == ':'; none of the
+    // following parsers expect a separator character, so we advance the cursor
+    // upon calling them.
+    ++cursor;
+    return parse_after_scheme(uri_text, cursor, table);
+  };
+
+  // The first eight bytes of text, as a little-endian integer padded with
+  // zeros, so that a scheme and the "//" after it can be compared at once.
+  static constexpr std::uint64_t leading_bytes(std::string_view text) noexcept
+  {
+    std::uint64_t bytes = 0;
+    size_t const length = std::min<size_t>(text.length(), 8);
+    for (size_t index = 0; index < length; ++index)
+    {
+      bytes |= static_cast<std::uint64_t>(static_cast<unsigned char>(text[index])) << (8 * index);
+    }
+    return bytes;
+  };
+
+  // Whether leading_bytes() of some text begins with expected, whose letters
+  // match either case: setting bit 5 of just those bytes lowercases them,
+  // while the ':' and '/' are compared exactly.
+  static constexpr bool has_prefix(std::uint64_t bytes, std::string_view expected) noexcept
+  {
+    std::uint64_t value = 0;
+    std::uint64_t letters = 0;
+    std::uint64_t mask = 0;
+    for (size_t index = 0; index < expected.length(); ++index)
+    {
+      value |= static_cast<std::uint64_t>(static_cast<unsigned char>(expected[index])) << (8 * index);
+      mask |= std::uint64_t(0xFF) << (8 * index);
+      letters |= is_alpha(expected[index]) ? (std::uint64_t(0x20) << (8 * index)) : 0;
+    }
+    return ((bytes & mask) | letters) == value;
+  };
+
+  // Recognizes "http://", "https://", "ws://" or "wss://" at the start of
+  // the text, recording the scheme and leaving cursor after the "//".
+  static constexpr bool parse_web_prefix(std::string_view uri_text, size_t &cursor,
+                                         component_table &table) noexcept
+  {
+    std::uint64_t const bytes = leading_bytes(uri_text);
+    size_t scheme_length = 0;
+    if (has_prefix(bytes, "https://"))
+    {
+      table.scheme = known_scheme::https;
+      scheme_length = 5;
+    }
+    else if (has_prefix(bytes, "http://"))
+    {
+      table.scheme = known_scheme::http;
+      scheme_length = 4;
+    }
+    else if (has_prefix(bytes, "wss://"))
+    {
+      table.scheme = known_scheme::wss;
+      scheme_length = 3;
+    }
+    else if (has_prefix(bytes, "ws://"))
+    {
+      table.scheme = known_scheme::ws;
+      scheme_length = 2;
+    }
+    else
+    {
+      return false;
+    }
+
+    set_span(table, component::Scheme, 0, scheme_length);
+    table.category = scheme_category::Hierarchical;
+    table.has_authority = true;
+    cursor = scheme_length + 3;
+    return true;
+  };
+
+  /* Parses the rest of a URI that parse_web_prefix recognized. The authority
+   * of such a URI is almost always a registered name and perhaps a port, so
+   * one scan finds its end and any ':'; userinfo or an IP literal sends it
+   * to parse_authority instead. The path, query and fragment are parsed as
+   * they are for any other URI.
+   */
+  static constexpr parse_error parse_web_uri(std::string_view uri_text, size_t &cursor,
+                                             component_table &table) noexcept
+  {
+    size_t const content_start = cursor - 2;
+    size_t const authority_start = cursor;
+    size_t host_end = uri_detail::find_delimiter<'/', '?', '#', ':', '@', '['>(uri_text, cursor);
+    size_t authority_end = host_end;
+    char const found = (host_end == uri_text.length()) ? '\0' : uri_text[host_end];
+    if (found == ':')
+    {
+      authority_end = uri_detail::find_delimiter<'/', '?', '#', '@'>(uri_text, (host_end + 1));
+    }
+
+    if ((found == '@') || (found == '[')
+        || ((authority_end != uri_text.length()) && (uri_text[authority_end] == '@')))
+    {
+      cursor = authority_start;
+      parse_error const error = parse_authority(uri_text, cursor, table);
+      if (error != parse_error::none)
+      {
+        return error;
+      }
+    }
+    else
+    {
+      table.host = classify_name(uri_text.substr(authority_start, (host_end - authority_start)));
+      set_span(table, component::Host, authority_start, host_end);
+      cursor = host_end;
+      if (found == ':')
+      {
+        parse_error const error = parse_port(uri_text.substr(0, authority_end), ++cursor, table);
+        if (error != parse_error::none)
+        {
+          return error;
+        }
+      }
+    }
+
+    parse_path(uri_text, cursor, table);
+    set_span(table, component::Content, content_start, cursor);
+    parse_query_and_fragment(uri_text, cursor, table);
+    return parse_error::none;
+  };
+
+  // Recognizes the well-known schemes, in any case.
+  static constexpr known_scheme identify_scheme(std::string_view scheme) noexcept
+  {
+    std::uint64_t const bytes = (scheme.length() <= 6) ? leading_bytes(scheme) : 0;
+    switch (scheme.length())
+    {
+    case 2:
+      return has_prefix(bytes, "ws") ? known_scheme::ws : known_scheme::other;
+    case 3:
+      return has_prefix(bytes, "wss") ? known_scheme::wss : has_prefix(bytes, "ftp") ? known_scheme::ftp
+        : has_prefix(bytes, "urn") ? known_scheme::urn : known_scheme::other;
+    case 4:
+      return has_prefix(bytes, "http") ? known_scheme::http : has_prefix(bytes, "file") ? known_scheme::file
+        : has_prefix(bytes, "data") ? known_scheme::data : known_scheme::other;
+    case 5:
+      return has_prefix(bytes, "https") ? known_scheme::https : known_scheme::other;
+    case 6:
+      return has_prefix(bytes, "mailto") ? known_scheme::mailto : known_scheme::other;
+    default:
+      return known_scheme::other;
+    }
+  };
+
+  // The category scheme_category::Automatic resolves to.
+  static constexpr scheme_category category_of(known_scheme scheme, bool slash_follows) noexcept
+  {
+    switch (scheme)
+    {
+    case known_scheme::mailto:
+    case known_scheme::urn:
+    case known_scheme::data:
+      return scheme_category::NonHierarchical;
+    case known_scheme::other:
+      return slash_follows ? scheme_category::Hierarchical : scheme_category::NonHierarchical;
+    default:
+      return scheme_category::Hierarchical;
+    }
+  };
+
+  // Parses a URI reference (RFC 3986 section 4.1): either a URI, or a
+  // relative reference, which has no scheme and is always hierarchical. Unlike
+  // a URI, an empty reference is valid; it refers to the base itself.
+  static constexpr parse_error parse_reference(std::string_view reference, component_table &table,
+                                               size_t &cursor) noexcept
+  {
+    table.category = scheme_category::Hierarchical;
+    if (starts_with_scheme(reference))
+    {
+      return parse_components(reference, table, cursor);
+    }
+
+    clear_components(table);
+    cursor = 0;
+    if (reference.length() > UINT32_MAX)
+    {
+      return parse_error::too_long;
+    }
+    return parse_after_scheme(reference, cursor, table);
+  };
+
+  static constexpr void clear_components(component_table &table) noexcept
+  {
+    table.spans = {};
+    table.scheme = known_scheme::other;
+    table.port = 0;
+    table.host = host_type::none;
+    table.path_is_rooted = false;
+    table.has_authority = false;
+    table.path_segments = 0;
+    table.last_segment = 0;
+    table.normalized = false;
+  };
+
+  // Whether a reference starts with a scheme: a letter followed by letters,
+  // digits, '+', '-' or '.' up to a ':'. If not, it's a relative reference,
+  // whose first segment can't hold a ':' (RFC 3986 section 4.2).
+  static constexpr bool starts_with_scheme(std::string_view reference) noexcept
+  {
+    if (reference.empty() || !is_alpha(reference[0]))
+    {
+      return false;
+    }
+
+    for (size_t index = 1; index < reference.length(); ++index)
+    {
+      if (reference[index] == ':')
+      {
+        return true;
+      }
+      if (!is_scheme_character(reference[index]))
+      {
+        return false;
+      }
+    }
+    return false;
+  };
+
+  // ASCII-only classification; unlike <cctype>, it's usable at compile time
+  // and doesn't depend on the locale.
+  static constexpr bool is_alpha(char c) noexcept
+  {
+    return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z'));
+  };
+
+  static constexpr bool is_scheme_character(char c) noexcept
+  {
+    return is_alpha(c) || ((c >= '0') && (c <= '9')) || (c == '+') || (c == '-') || (c == '.');
+  };
+
+  // Parses everything following the scheme and its ':'.
+  static constexpr parse_error parse_after_scheme(std::string_view uri_text, size_t &cursor,
+                                                  component_table &table) noexcept
+  {
+    parse_error const error = parse_content(uri_text, cursor, table);
+    if (error != parse_error::none)
+    {
+      return error;
+    }
+
+    parse_query_and_fragment(uri_text, cursor, table);
+    return parse_error::none;
+  };
+
+  static constexpr void parse_query_and_fragment(std::string_view uri_text, size_t &cursor,
+                                                 component_table &table) noexcept
+  {
+    if ((cursor != uri_text.length()) && (uri_text[cursor] == '?'))
+    {
+      ++cursor;
+      parse_query(uri_text, cursor, table);
+    }
+
+    if ((cursor != uri_text.length()) && (uri_text[cursor] == '#'))
+    {
+      ++cursor;
+      parse_fragment(uri_text, cursor, table);
+    }
+  };
+
+  static constexpr parse_error parse_scheme(std::string_view uri_text, size_t &cursor,
+                                            component_table &table) noexcept
+  {
+    size_t const scheme_start = cursor;
+    while ((cursor != uri_text.length()) && (uri_text[cursor] != ':'))
+    {
+      if (!is_scheme_character(uri_text[cursor]))
+      {
+        return parse_error::invalid_scheme_character;
+      }
+      ++cursor;
+    }
+
+    if (cursor == uri_text.length())
+    {
+      return parse_error::missing_scheme_separator;
+    }
+
+    if (cursor == scheme_start)
+    {
+      return parse_error::empty_scheme;
+    }
+
+    set_span(table, component::Scheme, scheme_start, cursor);
+    table.scheme = identify_scheme(uri_text.substr(scheme_start, (cursor - scheme_start)));
+    return parse_error::none;
+  };
+
+  static constexpr parse_error parse_content(std::string_view uri_text, size_t &cursor,
+                                             component_table &table) noexcept
+  {
+    size_t const content_start = cursor;
+
+    if (table.category == scheme_category::Hierarchical)
+    {
+      // If it's a hierarchical URI, the content is parsed for the hierarchical
+      // components as we go.
+      if (!uri_text.compare(cursor, 2, "//"))
+      {
+        // In this case an authority component is present.
+        table.has_authority = true;
+        cursor += 2;
+        parse_error const error = parse_authority(uri_text, cursor, table);
+        if (error != parse_error::none)
+        {
+          return error;
+        }
+      }
+
+      parse_path(uri_text, cursor, table);
+    }
+    else
+    {
+      cursor = find_content_end(uri_text, cursor);
+    }
+
+    set_span(table, component::Content, content_start, cursor);
+    return parse_error::none;
+  };
+
+  static constexpr void parse_path(std::string_view uri_text, size_t &cursor, component_table &table) noexcept
+  {
+    if ((cursor != uri_text.length()) && (uri_text[cursor] == '/'))
+    {
+      // Then the path is rooted, and we should note this.
+      table.path_is_rooted = true;
+      ++cursor;
+    }
+
+    size_t const path_start = cursor;
+    std::uint32_t slashes = 0;
+    size_t last_slash = path_start - 1;
+    cursor = uri_detail::scan_path(uri_text, cursor, slashes, last_slash);
+    set_span(table, component::Path, path_start, cursor);
+    table.path_segments = (cursor == path_start) ? 0 : (slashes + 1);
+    table.last_segment = static_cast<std::uint32_t>(last_slash + 1 - path_start);
+  };
+
+  // Counts the segments of a path that was set rather than parsed.
+  static constexpr void index_path(std::string_view path, component_table &table) noexcept
+  {
+    std::uint32_t slashes = 0;
+    size_t last_slash = std::string_view::npos;
+    uri_detail::scan_path(path, 0, slashes, last_slash);
+    table.path_segments = path.empty() ? 0 : (slashes + 1);
+    table.last_segment = static_cast<std::uint32_t>(last_slash + 1);
+  };
+
+  static constexpr size_t find_content_end(std::string_view uri_text, size_t cursor) noexcept
+  {
+    return uri_detail::find_delimiter<'?', '#'>(uri_text, cursor);
+  };
+
+  static constexpr parse_error parse_authority(std::string_view uri_text, size_t &cursor,
+                                               component_table &table) noexcept
+  {
+    // Find the extent of the authority first, noting whether it holds an '@';
+    // only an '@' within the authority separates the userinfo, and one found
+    // later on belongs to the path.
+    size_t authority_end = uri_detail::find_delimiter<'/', '?', '#', '@'>(uri_text, cursor);
+    size_t userinfo_end = std::string_view::npos;
+    if ((authority_end != uri_text.length()) && (uri_text[authority_end] == '@'))
+    {
+      userinfo_end = authority_end;
+      authority_end = uri_detail::find_delimiter<'/', '?', '#'>(uri_text, (authority_end + 1));
+    }
+
+    std::string_view const authority = uri_text.substr(0, authority_end);
+    parse_error error = parse_error::none;
+    if (userinfo_end != std::string_view::npos)
+    {
+      error = parse_username(authority, cursor, table);
+      if (error != parse_error::none)
+      {
+        return error;
+      }
+      parse_password(authority, ++cursor, table);
+      // After this call, authority[cursor] == '@', so we skip over it.
+      ++cursor;
+    }
+
+    error = parse_host(authority, cursor, table);
+    if (error != parse_error::none)
+    {
+      return error;
+    }
+
+    if ((cursor != authority_end) && (uri_text[cursor] == ':'))
+    {
+      error = parse_port(authority, ++cursor, table);
+      if (error != parse_error::none)
+      {
+        return error;
+      }
+    }
+
+    if (cursor != authority_end)
+    {
+      return parse_error::unexpected_host_character;
+    }
+    return parse_error::none;
+  };
+
+  static constexpr parse_error parse_username(std::string_view authority, size_t &cursor,
+                                              component_table &table) noexcept
+  {
+    size_t const username_start = cursor;
+    // Since this is only reachable when '@' was in the authority, we can
+    // ignore the end-of-string case.
+    while (authority[cursor] != ':')
+    {
+      if (authority[cursor] == '@')
+      {
+        return parse_error::missing_password;
+      }
+      ++cursor;
+    }
+    set_span(table, component::Username, username_start, cursor);
+    return parse_error::none;
+  };
+
+  static constexpr void parse_password(std::string_view authority, size_t &cursor,
+                                       component_table &table) noexcept
+  {
+    size_t const password_start = cursor;
+    while (authority[cursor] != '@')
+    {
+      ++cursor;
+    }
+    set_span(table, component::Password, password_start, cursor);
+  };
+
+  static constexpr parse_error parse_host(std::string_view authority, size_t &cursor,
+                                          component_table &table) noexcept
+  {
+    size_t const host_start = cursor;
+    // So, the host can contain a few things. It can be a domain, it can be an
+    // IPv4 address, it can be an IPv6 address, or an IPvFuture literal. In the
+    // case of those last two, it's of the form [...] where what's between the
+    // brackets is a matter of which IPv?? version it is.
+    cursor = uri_detail::find_delimiter<'[', ':'>(authority, cursor);
+    if ((cursor != authority.length()) && (authority[cursor] == '['))
+    {
+      // An IP literal is the whole of the host, so it can't follow anything.
+      if (cursor != host_start)
+      {
+        return parse_error::unexpected_host_character;
+      }
+
+      cursor = uri_detail::find_delimiter<']'>(authority, cursor);
+
+      if (cursor == authority.length())
+      {
+        return parse_error::unterminated_ip_literal;
+      }
+
+      std::string_view const literal = authority.substr((host_start + 1), (cursor - host_start - 1));
+      std::array<std::uint8_t, 16> address{};
+      size_t zone_start = 0;
+      if (is_ip_future(literal))
+      {
+        table.host = host_type::ipv_future;
+      }
+      else if (parse_ipv6(literal, address, zone_start))
+      {
+        table.host = host_type::ipv6;
+      }
+      else
+      {
+        cursor = host_start;
+        return parse_error::invalid_ip_literal;
+      }
+
+      // We found the end of the IP literal, which is the whole of the host
+      // component when one's in use.
+      ++cursor;
+    }
+    else
+    {
+      table.host = classify_name(authority.substr(host_start, (cursor - host_start)));
+    }
+
+    set_span(table, component::Host, host_start, cursor);
+    return parse_error::none;
+  };
+
+  // Classifies a host that isn't in brackets.
+  static constexpr host_type classify_name(std::string_view host) noexcept
+  {
+    std::array<std::uint8_t, 4> address{};
+    if (host.empty())
+    {
+      return host_type::none;
+    }
+    return parse_ipv4(host, address) ? host_type::ipv4 : host_type::reg_name;
+  };
+
+  // Parses a dotted-quad IPv4 address strictly, as RFC 3986's IPv4address:
+  // exactly four decimal octets of at most 255, without leading zeros.
+  static constexpr bool parse_ipv4(std::string_view text, std::array<std::uint8_t, 4> &address) noexcept
+  {
+    size_t cursor = 0;
+    for (size_t octet = 0; octet < 4; ++octet)
+    {
+      if ((octet != 0) && ((cursor == text.length()) || (text[cursor++] != '.')))
+      {
+        return false;
+      }
+
+      size_t const octet_start = cursor;
+      unsigned value = 0;
+      while ((cursor != text.length()) && (text[cursor] >= '0') && (text[cursor] <= '9')
+             && ((cursor - octet_start) < 3))
+      {
+        value = (value * 10) + static_cast<unsigned>(text[cursor++] - '0');
+      }
+
+      size_t const digits = cursor - octet_start;
+      if ((digits == 0) || (value > 255) || ((digits > 1) && (text[octet_start] == '0')))
+      {
+        return false;
+      }
+      address[octet] = static_cast<std::uint8_t>(value);
+    }
+    return cursor == text.length();
+  };
+
+  // Parses the text between the brackets of an IPv6 literal strictly, as RFC
+  // 3986's IPv6address (including a trailing dotted quad), optionally
+  // followed by a zone ID as in RFC 6874: "%25" and then one or more
+  // unreserved or percent-encoded characters. zone_start is left on the
+  // first character of the zone ID, or on the end of the text if there's
+  // none.
+  static constexpr bool parse_ipv6(std::string_view text, std::array<std::uint8_t, 16> &address,
+                                   size_t &zone_start) noexcept
+  {
+    zone_start = text.find('%');
+    if (zone_start == std::string_view::npos)
+    {
+      zone_start = text.length();
+    }
+    else
+    {
+      if (text.compare(zone_start, 3, "%25") || ((zone_start + 3) == text.length()))
+      {
+        return false;
+      }
+      for (size_t index = zone_start + 3; index < text.length(); ++index)
+      {
+        char const c = text[index];
+        if (c == '%')
+        {
+          if (((index + 2) >= text.length()) || !is_hex_digit(text[index + 1]) || !is_hex_digit(text[index + 2]))
+          {
+            return false;
+          }
+          index += 2;
+        }
+        else if (!(is_alpha(c) || ((c >= '0') && (c <= '9')) || (c == '-') || (c == '.')
+                   || (c == '_') || (c == '~')))
+        {
+          return false;
+        }
+      }
+      text = text.substr(0, zone_start);
+      zone_start += 3;
+    }
+
+    std::array<std::uint16_t, 8> groups{};
+    size_t count = 0;
+    bool compressed = false;
+    size_t compressed_at = 0;
+    size_t cursor = 0;
+    if (!text.compare(0, 2, "::"))
+    {
+      compressed = true;
+      cursor = 2;
+    }
+
+    while (cursor != text.length())
+    {
+      size_t const group_start = cursor;
+      unsigned value = 0;
+      while ((cursor != text.length()) && ((cursor - group_start) < 5))
+      {
+        std::int8_t const digit = uri_detail::hex_digit_values[static_cast<unsigned char>(text[cursor])];
+        if (digit < 0)
+        {
+          break;
+        }
+        value = (value << 4) | static_cast<unsigned>(digit);
+        ++cursor;
+      }
+
+      if ((cursor != text.length()) && (text[cursor] == '.'))
+      {
+        // A trailing dotted quad fills the last two groups.
+        std::array<std::uint8_t, 4> ipv4{};
+        if ((count > 6) || !parse_ipv4(text.substr(group_start), ipv4))
+        {
+          return false;
+        }
+        groups[count++] = static_cast<std::uint16_t>((ipv4[0] << 8) | ipv4[1]);
+        groups[count++] = static_cast<std::uint16_t>((ipv4[2] << 8) | ipv4[3]);
+        cursor = text.length();
+        break;
+      }
+
+      if ((cursor == group_start) || ((cursor - group_start) > 4) || (count == 8))
+      {
+        return false;
+      }
+      groups[count++] = static_cast<std::uint16_t>(value);
+
+      if (cursor == text.length())
+      {
+        break;
+      }
+      if (text[cursor++] != ':')
+      {
+        return false;
+      }
+      if ((cursor != text.length()) && (text[cursor] == ':'))
+      {
+        if (compressed)
+        {
+          return false;
+        }
+        compressed = true;
+        compressed_at = count;
+        ++cursor;
+      }
+      else if (cursor == text.length())
+      {
+        return false;
+      }
+    }
+
+    if (compressed ? (count > 7) : (count != 8))
+    {
+      return false;
+    }
+
+    // Expand the "::", moving the groups that follow it to the end.
+    size_t const missing = 8 - count;
+    for (size_t group = 8; group-- > 0;)
+    {
+      std::uint16_t value = 0;
+      if (!compressed || (group < compressed_at))
+      {
+        value = groups[group];
+      }
+      else if (group >= (compressed_at + missing))
+      {
+        value = groups[group - missing];
+      }
+      address[group * 2] = static_cast<std::uint8_t>(value >> 8);
+      address[(group * 2) + 1] = static_cast<std::uint8_t>(value & 0xFF);
+    }
+    return true;
+  };
+
+  // Classifies a host given on its own, as the component constructors take
+  // it, throwing if it's a malformed IP literal.
+  static host_type host_type_of(std::string_view host)
+  {
+    if (host.empty() || (host.front() != '['))
+    {
+      return classify_name(host);
+    }
+
+    component_table table{};
+    size_t cursor = 0;
+    if ((parse_host(host, cursor, table) != parse_error::none) || (cursor != host.length()))
+    {
+      throw std::invalid_argument(describe(parse_error::invalid_ip_literal));
+    }
+    return table.host;
+  };
+
+  static constexpr std::optional<std::array<std::uint8_t, 4>> ipv4_address(std::string_view host,
+                                                                           host_type type) noexcept
+  {
+    std::array<std::uint8_t, 4> address{};
+    if ((type != host_type::ipv4) || !parse_ipv4(host, address))
+    {
+      return std::nullopt;
+    }
+    return address;
+  };
+
+  static constexpr std::optional<std::array<std::uint8_t, 16>> ipv6_address(std::string_view host,
+                                                                            host_type type) noexcept
+  {
+    std::array<std::uint8_t, 16> address{};
+    size_t zone_start = 0;
+    if ((type != host_type::ipv6) || !parse_ipv6(host.substr(1, (host.length() - 2)), address, zone_start))
+    {
+      return std::nullopt;
+    }
+    return address;
+  };
+
+  static constexpr std::string_view zone_id(std::string_view host, host_type type) noexcept
+  {
+    size_t const zone_start = host.find("%25");
+    if ((type != host_type::ipv6) || (zone_start == std::string_view::npos))
+    {
+      return std::string_view();
+    }
+    return host.substr((zone_start + 3), (host.length() - zone_start - 4));
+  };
+
+  // RFC 3986's IPvFuture: "v", one or more hex digits, ".", and then one or
+  // more unreserved or sub-delim characters or colons.
+  static constexpr bool is_ip_future(std::string_view text) noexcept
+  {
+    if ((text.length() < 4) || ((text[0] != 'v') && (text[0] != 'V')))
+    {
+      return false;
+    }
+
+    size_t cursor = 1;
+    while ((cursor != text.length()) && is_hex_digit(text[cursor]))
+    {
+      ++cursor;
+    }
+    if ((cursor == 1) || (cursor == text.length()) || (text[cursor] != '.') || ((cursor + 1) == text.length()))
+    {
+      return false;
+    }
+
+    for (++cursor; cursor != text.length(); ++cursor)
+    {
+      char const c = text[cursor];
+      if (!(is_alpha(c) || ((c >= '0') && (c <= '9')) || (std::string_view("-._~!$&'()*+,;=:").find(c) != std::string_view::npos)))
+      {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  static constexpr parse_error parse_port(std::string_view authority, size_t &cursor,
+                                          component_table &table) noexcept
+  {
+    size_t const port_start = cursor;
+    unsigned long port = 0;
+    while (cursor != authority.length())
+    {
+      char const c = authority[cursor];
+      if ((c < '0') || (c > '9'))
+      {
+        return parse_error::invalid_port;
+      }
+
+      port = (port * 10) + static_cast<unsigned long>(c - '0');
+      if (port > 65535)
+      {
+        return parse_error::port_out_of_range;
+      }
+      ++cursor;
+    }
+
+    set_span(table, component::Port, port_start, cursor);
+    table.port = static_cast<std::uint16_t>(port);
+    return parse_error::none;
+  };
+
+  static constexpr void parse_query(std::string_view uri_text, size_t &cursor,
+                                    component_table &table) noexcept
+  {
+    size_t const query_start = cursor;
+    // Queries can contain almost any character except hash, which is reserved
+    // for the start of the fragment.
+    cursor = uri_detail::find_delimiter<'#'>(uri_text, cursor);
+    set_span(table, component::Query, query_start, cursor);
+  };
+
+  static constexpr void parse_fragment(std::string_view uri_text, size_t &cursor,
+                                       component_table &table) noexcept
+  {
+    set_span(table, component::Fragment, cursor, uri_text.length());
+    cursor = uri_text.length();
+  };
+
+  static std::uint16_t port_from_string(std::string const &port_text)
+  {
+    unsigned long const port = std::stoul(port_text);
+    if (port > 65535)
+    {
+      throw std::invalid_argument(describe(parse_error::port_out_of_range));
+    }
+    return static_cast<std::uint16_t>(port);
+  };
+
+  static size_t count_digits(std::uint16_t value) noexcept
+  {
+    return (value >= 10000) ? 5 : (value >= 1000) ? 4 : (value >= 100) ? 3 : (value >= 10) ? 2 : 1;
+  };
+
+  // Returns the length of the string serialize() will produce, so that it can
+  // be written with a single allocation.
+  static size_t serialized_size(component_parts const &parts, component_table const &table) noexcept
+  {
+    auto const part = [&](component which) {
+      return parts[static_cast<size_t>(which)];
+    };
+
+    size_t size = part(component::Scheme).length() + 1;
+    if (table.category == scheme_category::Hierarchical)
+    {
+      if (table.has_authority)
+      {
+        size += 2;
+        if (!(part(component::Username).empty() && part(component::Password).empty()))
+        {
+          size += part(component::Username).length() + part(component::Password).length() + 2;
+        }
+        size += part(component::Host).length();
+        if (table.port != 0)
+        {
+          size += count_digits(table.port) + 1;
+        }
+      }
+      size += (table.path_is_rooted || (table.has_authority && !part(component::Path).empty())) ? 1 : 0;
+      size += part(component::Path).length();
+    }
+    else
+    {
+      size += part(component::Content).length();
+    }
+
+    size += part(component::Query).empty() ? 0 : (part(component::Query).length() + 1);
+    size += part(component::Fragment).empty() ? 0 : (part(component::Fragment).length() + 1);
+    return size;
+  };
+
+  // Writes the components out as a single URI in its normalized form,
+  // recording where each one lands in the table's spans. Empty components are
+  // dropped along with their delimiters, as is a zero port; the "//" before
+  // the authority is only written when there is one.
+  template <typename String>
+  static void serialize(component_parts const &parts, component_table &table, String &out)
+  {
+    size_t const size = serialized_size(parts, table);
+    if (size > UINT32_MAX)
+    {
+      throw std::length_error("URIs cannot be longer than 4GiB.");
+    }
+
+    out.clear();
+    out.reserve(size);
+    table.spans = {};
+
+    auto const append = [&](component which) {
+      size_t const begin = out.length();
+      out.append(parts[static_cast<size_t>(which)]);
+      set_span(table, which, begin, out.length());
+    };
+
+    append(component::Scheme);
+    out.push_back(':');
+    size_t const content_start = out.length();
+
+    if (table.category == scheme_category::Hierarchical)
+    {
+      if (table.has_authority)
+      {
+        out.append("//");
+        if (!(parts[static_cast<size_t>(component::Username)].empty()
+              && parts[static_cast<size_t>(component::Password)].empty()))
+        {
+          append(component::Username);
+          out.push_back(':');
+          append(component::Password);
+          out.push_back('@');
+        }
+
+        append(component::Host);
+
+        if (table.port != 0)
+        {
+          out.push_back(':');
+          size_t const port_start = out.length();
+          char digits[5];
+          size_t const digit_count = count_digits(table.port);
+          for (size_t index = digit_count, port = table.port; index > 0; port /= 10)
+          {
+            digits[--index] = static_cast<char>('0' + (port % 10));
+          }
+          out.append(digits, digit_count);
+          set_span(table, component::Port, port_start, out.length());
+        }
+
+        // A path following an authority is always rooted.
+        table.path_is_rooted = table.path_is_rooted || !parts[static_cast<size_t>(component::Path)].empty();
+      }
+
+      if (table.path_is_rooted)
+      {
+        out.push_back('/');
+      }
+      append(component::Path);
+      index_path(parts[static_cast<size_t>(component::Path)], table);
+      set_span(table, component::Content, content_start, out.length());
+    }
+    else
+    {
+      table.path_is_rooted = false;
+      table.path_segments = 0;
+      table.last_segment = 0;
+      append(component::Content);
+    }
+
+    if (!parts[static_cast<size_t>(component::Query)].empty())
+    {
+      out.push_back('?');
+      append(component::Query);
+    }
+
+    if (!parts[static_cast<size_t>(component::Fragment)].empty())
+    {
+      out.push_back('#');
+      append(component::Fragment);
+    }
+  };
+
+  // Stores the components of a table parsed from uri_text, serializing them
+  // into the URI's own buffer.
+  void assign(std::string_view uri_text, component_table const &table)
+  {
+    component_parts parts;
+    for (size_t index = 0; index < parts.size(); ++index)
+    {
+      parts[index] = uri_text.substr(table.spans[index].offset, table.spans[index].length);
+    }
+
+    m_components = table;
+    serialize(parts, m_components, m_text);
+    m_query_index.clear();
+    m_query_indexed = false;
+  };
+
+  void require_hierarchical(char const *name) const
+  {
+    if (m_components.category != scheme_category::Hierarchical)
+    {
+      throw std::domain_error(std::string("The ") + name + " component is only valid for hierarchical URIs.");
+    }
+  };
+
+  /* Replaces the text between begin and end with the concatenation of
+   * pieces, for a change to the given component, and moves the components
+   * that follow it along; the caller updates the component's own span. The
+   * content of a hierarchical URI holds its authority and path, so it grows
+   * or shrinks with them instead.
+   */
+  void splice(component which, size_t begin, size_t end, std::initializer_list<std::string_view> pieces)
+  {
+    size_t length = 0;
+    for (std::string_view const piece : pieces)
+    {
+      length += piece.length();
+    }
+    if ((m_text.length() - (end - begin) + length) > UINT32_MAX)
+    {
+      throw std::length_error("URIs cannot be longer than 4GiB.");
+    }
+
+    m_text.replace(begin, (end - begin), length, '\0');
+    size_t cursor = begin;
+    for (std::string_view const piece : pieces)
+    {
+      piece.copy(&m_text[cursor], piece.length());
+      cursor += piece.length();
+    }
+
+    std::uint32_t const delta = static_cast<std::uint32_t>(length - (end - begin));
+    bool const in_content = (m_components.category == scheme_category::Hierarchical)
+      && (which >= component::Username) && (which <= component::Path);
+    for (size_t index = 0; index < m_components.spans.size(); ++index)
+    {
+      component_span &span = m_components.spans[index];
+      if (static_cast<component>(index) == component::Content)
+      {
+        span.length += in_content ? delta : 0;
+      }
+      // Components that aren't present are left at offset 0.
+      else if ((index > static_cast<size_t>(which)) && (span.offset != 0))
+      {
+        span.offset += delta;
+      }
+    }
+
+    m_components.normalized = false;
+    m_query_index.clear();
+    m_query_indexed = false;
+  };
+
+  // Rebuilds the URI with one component replaced, for the changes that add
+  // an authority to a URI without one.
+  void rebuild(component which, std::string_view text)
+  {
+    component_parts parts;
+    for (size_t index = 0; index < parts.size(); ++index)
+    {
+      parts[index] = get_component(static_cast<component>(index));
+    }
+    parts[static_cast<size_t>(which)] = text;
+
+    std::pmr::string rebuilt(m_text.get_allocator());
+    m_components.has_authority = true;
+    m_components.normalized = false;
+    serialize(parts, m_components, rebuilt);
+    m_text.swap(rebuilt);
+    m_query_index.clear();
+    m_query_indexed = false;
+  };
+
+  void setup(std::string_view uri_text, scheme_category category)
+  {
+    component_table table;
+    table.category = category;
+    size_t cursor;
+    parse_error const error = parse_components(uri_text, table, cursor);
+    if (error != parse_error::none)
+    {
+      throw std::invalid_argument(describe_failure(error, uri_text));
+    }
+    assign(uri_text, table);
+  };
+
+  /* Resolves reference against base as in RFC 3986 section 5.2, serializing
+   * the target into out and recording its components in target. The merged
+   * path is assembled in path_buffer, where its dot segments are removed in
+   * place; both strings keep their capacity from one call to the next, so
+   * resolving into warm buffers doesn't allocate. Neither may alias the
+   * reference. On failure, cursor is left where the reference's parse stopped.
+   */
+  template <typename String>
+  static parse_error resolve_reference(uri const &base, std::string_view reference,
+                                       std::string &path_buffer, String &out,
+                                       component_table &target, size_t &cursor)
+  {
+    component_table relative;
+    parse_error const error = parse_reference(reference, relative, cursor);
+    if (error != parse_error::none)
+    {
+      return error;
+    }
+
+    auto const relative_part = [&](component which) {
+      component_span const &span = relative.spans[static_cast<size_t>(which)];
+      return reference.substr(span.offset, span.length);
+    };
+    // A component that's present but empty, like the query of "?", still
+    // starts after its delimiter, so only an absent one has a zero offset.
+    auto const defined = [&](component which) {
+      component_span const &span = relative.spans[static_cast<size_t>(which)];
+      return (span.offset != 0) || (span.length != 0);
+    };
+
+    component_parts parts;
+    bool const has_scheme = defined(component::Scheme);
+    if (!has_scheme && (base.m_components.category != scheme_category::Hierarchical))
+    {
+      // There's no path to merge with, but a fragment can still be replaced.
+      if (relative.has_authority || relative.path_is_rooted
+          || !relative_part(component::Path).empty() || defined(component::Query))
+      {
+        cursor = 0;
+        return parse_error::non_hierarchical_base;
+      }
+
+      for (size_t index = 0; index < parts.size(); ++index)
+      {
+        parts[index] = base.get_component(static_cast<component>(index));
+      }
+      parts[static_cast<size_t>(component::Fragment)] = relative_part(component::Fragment);
+      target = base.m_components;
+      target.normalized = false;
+      serialize(parts, target, out);
+      return parse_error::none;
+    }
+
+    bool const inherits_authority = !has_scheme && !relative.has_authority;
+    component_table const &authority_source = inherits_authority ? base.m_components : relative;
+    for (component which : { component::Username, component::Password, component::Host })
+    {
+      parts[static_cast<size_t>(which)] = inherits_authority ? base.get_component(which) : relative_part(which);
+    }
+    target.category = scheme_category::Hierarchical;
+    target.scheme = has_scheme ? relative.scheme : base.m_components.scheme;
+    target.host = authority_source.host;
+    target.port = authority_source.port;
+    target.has_authority = authority_source.has_authority;
+    target.normalized = false;
+
+    parts[static_cast<size_t>(component::Scheme)] =
+      has_scheme ? relative_part(component::Scheme) : base.get_component(component::Scheme);
+    parts[static_cast<size_t>(component::Query)] = relative_part(component::Query);
+    parts[static_cast<size_t>(component::Fragment)] = relative_part(component::Fragment);
+
+    if (inherits_authority && !relative.path_is_rooted && relative_part(component::Path).empty())
+    {
+      // An empty path refers to the base's path, and to its query too unless
+      // the reference has one of its own.
+      parts[static_cast<size_t>(component::Path)] = base.get_component(component::Path);
+      target.path_is_rooted = base.m_components.path_is_rooted;
+      if (!defined(component::Query))
+      {
+        parts[static_cast<size_t>(component::Query)] = base.get_component(component::Query);
+      }
+    }
+    else
+    {
+      path_buffer.clear();
+      if (inherits_authority && !relative.path_is_rooted)
+      {
+        // Merge the paths (section 5.2.3): the reference's path replaces
+        // everything after the last '/' of the base's.
+        std::string_view const base_path = base.get_component(component::Path);
+        if (base.m_components.path_is_rooted || base.m_components.has_authority)
+        {
+          path_buffer.push_back('/');
+        }
+        size_t const last_slash = base_path.rfind('/');
+        if (last_slash != std::string_view::npos)
+        {
+          path_buffer.append(base_path.substr(0, (last_slash + 1)));
+        }
+      }
+      else if (relative.path_is_rooted)
+      {
+        path_buffer.push_back('/');
+      }
+      path_buffer.append(relative_part(component::Path));
+      // Most paths have no dot segments, and a segment can only be one if it
+      // starts with '.'.
+      if ((path_buffer.find("/.") != std::string::npos) || (!path_buffer.empty() && (path_buffer[0] == '.')))
+      {
+        path_buffer.resize(remove_dot_segments(path_buffer.data(), path_buffer.length()));
+      }
+
+      target.path_is_rooted = !path_buffer.empty() && (path_buffer[0] == '/');
+      parts[static_cast<size_t>(component::Path)] =
+        std::string_view(path_buffer).substr(target.path_is_rooted ? 1 : 0);
+    }
+
+    serialize(parts, target, out);
+    return parse_error::none;
+  };
+
+  // The core of decode_component; out may be text itself, since the output
+  // never overtakes the input.
+  static size_t decode_into(char const *text, size_t length, char *out, bool plus_as_space) noexcept
+  {
+    std::string_view const input(text, length);
+    size_t cursor = 0;
+    size_t written = 0;
+    while (true)
+    {
+      size_t const next = plus_as_space ? uri_detail::find_delimiter<'%', '+'>(input, cursor)
+                                        : uri_detail::find_delimiter<'%'>(input, cursor);
+      if ((out + written) != (text + cursor))
+      {
+        std::memmove((out + written), (text + cursor), (next - cursor));
+      }
+      written += next - cursor;
+      if (next == length)
+      {
+        return written;
+      }
+
+      if (text[next] == '+')
+      {
+        out[written++] = ' ';
+        cursor = next + 1;
+      }
+      else if (((next + 2) < length) && is_hex_digit(text[next + 1]) && is_hex_digit(text[next + 2]))
+      {
+        out[written++] = static_cast<char>((hex_value(text[next + 1]) << 4) | hex_value(text[next + 2]));
+        cursor = next + 3;
+      }
+      else
+      {
+        out[written++] = '%';
+        cursor = next + 1;
+      }
+    }
+  };
+
+  // Whether a character that isn't unreserved may still appear unencoded in
+  // a component; see encode_component.
+  static constexpr bool allowed_unencoded_in(char c, component which) noexcept
+  {
+    bool const sub_delim = std::string_view("!$&'()*+,;=").find(c) != std::string_view::npos;
+    switch (which)
+    {
+    case component::Username:
+    case component::Host:
+      return sub_delim;
+    case component::Password:
+      return sub_delim || (c == ':');
+    case component::Path:
+    case component::Content:
+      return sub_delim || (c == ':') || (c == '@') || (c == '/');
+    case component::Fragment:
+      return sub_delim || (c == ':') || (c == '@') || (c == '/') || (c == '?');
+    case component::Query:
+      return (sub_delim && (c != '&') && (c != ';') && (c != '=') && (c != '+'))
+        || (c == ':') || (c == '@') || (c == '/') || (c == '?');
+    default:
+      return false;
+    }
+  };
+
+  // As allowed_unencoded_in, or whether the character is unreserved, looked
+  // up in a table with a bit per component.
+  static bool may_appear_unencoded(char c, component which) noexcept
   {
-    Hierarchical,
-    NonHierarchical
+    static constexpr std::array<std::uint16_t, 256> allowed = []() {
+      std::array<std::uint16_t, 256> table{};
+      for (size_t index = 0; index < table.size(); ++index)
+      {
+        for (size_t bit = 0; bit < 9; ++bit)
+        {
+          if (uri_detail::is_unreserved(static_cast<char>(index))
+              || allowed_unencoded_in(static_cast<char>(index), static_cast<component>(bit)))
+          {
+            table[index] = static_cast<std::uint16_t>(table[index] | (1u << bit));
+          }
+        }
+      }
+      return table;
+    }();
+    return ((allowed[static_cast<unsigned char>(c)] >> static_cast<unsigned>(which)) & 1) != 0;
   };
 
-  enum class component
+  // Whether decoding would change text, given that '+' is decoded as a space.
+  static bool needs_query_decoding(std::string_view text) noexcept
   {
-    Scheme,
-    Content,
-    Username,
-    Password,
-    Host,
-    Port,
-    Path,
-    Query,
-    Fragment
+    return uri_detail::find_delimiter<'%', '+'>(text, 0) != text.length();
   };
 
-  enum class query_argument_separator
+  static constexpr bool is_hex_digit(char c) noexcept
   {
-    ampersand,
-    semicolon
+    return ((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'f')) || ((c >= 'A') && (c <= 'F'));
   };
 
-  uri(char const *uri_text, scheme_category category = scheme_category::Hierarchical,
-      query_argument_separator separator = query_argument_separator::ampersand) :
-    m_category(category),
-    m_port(0),
-    m_path_is_rooted(false),
-    m_separator(separator)
+  static constexpr unsigned hex_value(char c) noexcept
   {
-    setup(std::string(uri_text), category);
+    return (c <= '9') ? static_cast<unsigned>(c - '0') : static_cast<unsigned>((c | 0x20) - 'a' + 10);
   };
 
-  uri(std::string const &uri_text, scheme_category category = scheme_category::Hierarchical,
-      query_argument_separator separator = query_argument_separator::ampersand) :
-    m_category(category),
-    m_port(0),
-    m_path_is_rooted(false),
-    m_separator(separator)
+  static char to_lower(char c) noexcept
   {
-    setup(uri_text, category);
+    return ((c >= 'A') && (c <= 'Z')) ? static_cast<char>(c | 0x20) : c;
   };
 
-  uri(std::map<component, std::string> const &components,
-      scheme_category category,
-      bool rooted_path,
-      query_argument_separator separator = query_argument_separator::ampersand) :
-    m_category(category),
-    m_path_is_rooted(rooted_path),
-    m_separator(separator)
+  // Returns whether normalize() would change a component: that is, whether it
+  // holds an uppercase letter where case doesn't matter, an encoded unreserved
+  // character, or lowercase hex digits in a percent-encoding.
+  static bool component_needs_normalization(std::string_view text, bool lowercase) noexcept
   {
-    if (components.count(component::Scheme))
+    for (size_t index = 0; index < text.length(); ++index)
     {
-      if (components.at(component::Scheme).length() == 0)
+      char const c = text[index];
+      if (lowercase && (c >= 'A') && (c <= 'Z'))
       {
-	throw std::invalid_argument("Scheme cannot be empty.");
+        return true;
+      }
+      if ((c == '%') && ((index + 2) < text.length()) && is_hex_digit(text[index + 1])
+          && is_hex_digit(text[index + 2]))
+      {
+        unsigned char const decoded =
+          static_cast<unsigned char>((hex_value(text[index + 1]) << 4) | hex_value(text[index + 2]));
+        if (uri_detail::is_unreserved(static_cast<char>(decoded)) || (text[index + 1] >= 'a') || (text[index + 2] >= 'a'))
+        {
+          return true;
+        }
       }
-      m_scheme = components.at(component::Scheme);
-    }
-    else
-    {
-      throw std::invalid_argument("A URI must have a scheme.");
     }
+    return false;
+  };
 
-    if (category == scheme_category::Hierarchical)
+  static void append_normalized(std::string &out, std::string_view text, bool lowercase)
+  {
+    static char const hex_digits[] = "0123456789ABCDEF";
+    for (size_t index = 0; index < text.length(); ++index)
     {
-      if (components.count(component::Content))
+      char const c = text[index];
+      if ((c == '%') && ((index + 2) < text.length()) && is_hex_digit(text[index + 1])
+          && is_hex_digit(text[index + 2]))
       {
-	throw std::invalid_argument("The content component is only for use in non-hierarchical URIs.");
+        unsigned char const decoded =
+          static_cast<unsigned char>((hex_value(text[index + 1]) << 4) | hex_value(text[index + 2]));
+        if (uri_detail::is_unreserved(static_cast<char>(decoded)))
+        {
+          out.push_back(lowercase ? to_lower(static_cast<char>(decoded)) : static_cast<char>(decoded));
+        }
+        else
+        {
+          out.push_back('%');
+          out.push_back(hex_digits[decoded >> 4]);
+          out.push_back(hex_digits[decoded & 0xF]);
+        }
+        index += 2;
+      }
+      else
+      {
+        out.push_back(lowercase ? to_lower(c) : c);
       }
+    }
+  };
 
-      bool has_username = components.count(component::Username);
-      bool has_password = components.count(component::Password);
-      if (has_username && has_password)
+  // Returns whether a path (without its leading '/') has a "." or ".."
+  // segment.
+  static bool has_dot_segments(std::string_view path) noexcept
+  {
+    size_t segment_start = 0;
+    while (segment_start <= path.length())
+    {
+      size_t segment_end = path.find('/', segment_start);
+      if (segment_end == std::string_view::npos)
       {
-	m_username = components.at(component::Username);
-	m_password = components.at(component::Password);
+        segment_end = path.length();
       }
-      else if ((has_username && !has_password) || (!has_username && has_password))
+      std::string_view const segment = path.substr(segment_start, (segment_end - segment_start));
+      if ((segment == ".") || (segment == ".."))
       {
-	throw std::invalid_argument("If a username or password is supplied, both must be provided.");
+        return true;
       }
+      segment_start = segment_end + 1;
+    }
+    return false;
+  };
 
-      if (components.count(component::Host))
+  // The remove_dot_segments algorithm of RFC 3986 section 5.2.4, applied in
+  // place to a path that starts with '/'; returns the new length of the path.
+  // Since the output never outgrows the input, it's written over the input as
+  // the input is consumed.
+  static size_t remove_dot_segments(char *path, size_t length) noexcept
+  {
+    size_t read = 0;
+    size_t write = 0;
+    auto const input_starts_with = [&](std::string_view prefix) {
+      return std::string_view((path + read), (length - read)).substr(0, prefix.length()) == prefix;
+    };
+    auto const input_is = [&](std::string_view rest) {
+      return std::string_view((path + read), (length - read)) == rest;
+    };
+    auto const remove_last_output_segment = [&]() {
+      while ((write > 0) && (path[--write] != '/'))
       {
-	m_host = components.at(component::Host);
       }
+    };
 
-      if (components.count(component::Port))
+    while (read < length)
+    {
+      if (input_starts_with("../"))
       {
-	m_port = std::stoul(components.at(component::Port));
+        read += 3;
       }
-
-      if (components.count(component::Path))
+      else if (input_starts_with("./") || input_starts_with("/./"))
       {
-	m_path = components.at(component::Path);
+        read += 2;
       }
-      else
+      else if (input_is("/."))
       {
-	throw std::invalid_argument("A path is required on a hierarchical URI, even an empty path.");
+        path[++read] = '/';
       }
-    }
-    else
-    {
-      if (components.count(component::Username)
-	  || components.count(component::Password)
-	  || components.count(component::Host)
-	  || components.count(component::Port)
-	  || components.count(component::Path))
+      else if (input_starts_with("/../"))
       {
-	throw std::invalid_argument("None of the hierarchical components are allowed in a non-hierarchical URI.");
+        read += 3;
+        remove_last_output_segment();
       }
-
-      if (components.count(component::Content))
+      else if (input_is("/.."))
+      {
+        read += 2;
+        path[read] = '/';
+        remove_last_output_segment();
+      }
+      else if (input_is(".") || input_is(".."))
       {
-	m_content = components.at(component::Content);
+        read = length;
       }
       else
       {
-	throw std::invalid_argument("Content is a required component for a non-hierarchical URI, even an empty string.");
+        do
+        {
+          path[write++] = path[read++];
+        }
+        while ((read < length) && (path[read] != '/'));
       }
     }
+    return write;
+  };
 
-    if (components.count(component::Query))
+  // The port a scheme uses when none is given, or 0 for schemes without one
+  // (or that we don't know of).
+  static constexpr std::uint16_t default_port_for(known_scheme scheme) noexcept
+  {
+    switch (scheme)
     {
-      m_query = components.at(component::Query);
+    case known_scheme::http:
+    case known_scheme::ws:
+      return 80;
+    case known_scheme::https:
+    case known_scheme::wss:
+      return 443;
+    case known_scheme::ftp:
+      return 21;
+    default:
+      return 0;
     }
+  };
 
-    if (components.count(component::Fragment))
+  bool needs_normalization() const noexcept
+  {
+    bool const hierarchical = (m_components.category == scheme_category::Hierarchical);
+    for (component which : { component::Scheme, component::Username, component::Password,
+                             component::Host, component::Path, component::Content,
+                             component::Query, component::Fragment })
     {
-      m_fragment = components.at(component::Fragment);
+      // The content of a hierarchical URI overlaps its other components.
+      if (hierarchical && (which == component::Content))
+      {
+        continue;
+      }
+      if (component_needs_normalization(get_component(which),
+                                        (which == component::Scheme) || (which == component::Host)))
+      {
+        return true;
+      }
     }
-  }
 
-  uri(uri const &other, std::map<component, std::string> const &replacements) :
-    m_category(other.m_category),
-    m_path_is_rooted(other.m_path_is_rooted),
-    m_separator(other.m_separator)
-  {
-    m_scheme = (replacements.count(component::Scheme))
-      ? replacements.at(component::Scheme) : other.m_scheme;
+    if (m_components.path_is_rooted && has_dot_segments(get_component(component::Path)))
+    {
+      return true;
+    }
 
-    m_username = (replacements.count(component::Username))
-      ? replacements.at(component::Username) : other.m_username;
+    std::uint16_t const default_port = default_port_for(m_components.scheme);
+    return (default_port != 0) && (m_components.category == scheme_category::Hierarchical)
+      && m_components.has_authority
+      && ((m_components.port == default_port) || !m_components.path_is_rooted);
+  };
 
-    m_password = (replacements.count(component::Password))
-      ? replacements.at(component::Password) : other.m_password;
+  std::string_view get_component(component which) const noexcept
+  {
+    component_span const &span = m_components.spans[static_cast<size_t>(which)];
+    return std::string_view(m_text).substr(span.offset, span.length);
+  };
 
-    m_host = (replacements.count(component::Host))
-      ? replacements.at(component::Host) : other.m_host;
+  // Finds the parameter starting at carat, and moves carat past it and the
+  // separator that follows; returns false once the query is exhausted. If
+  // there's no '=' in a parameter, the key is given an empty value.
+  static constexpr bool next_query_parameter(std::string_view query, query_argument_separator separator,
+                                             size_t &carat, query_entry &entry) noexcept
+  {
+    if (carat > query.length())
+    {
+      return false;
+    }
 
-    m_port = (replacements.count(component::Port))
-      ? std::stoul(replacements.at(component::Port)) : other.m_port;
+    size_t stanza_end = (separator == query_argument_separator::ampersand)
+      ? uri_detail::find_delimiter<'&'>(query, carat)
+      : uri_detail::find_delimiter<';'>(query, carat);
+    size_t const key_value_divider = uri_detail::find_delimiter<'='>(query.substr(0, stanza_end), carat);
+
+    entry.key_offset = static_cast<std::uint32_t>(carat);
+    entry.key_length = static_cast<std::uint32_t>(key_value_divider - carat);
+    entry.value_offset = static_cast<std::uint32_t>(std::min((key_value_divider + 1), stanza_end));
+    entry.value_length = static_cast<std::uint32_t>(stanza_end - entry.value_offset);
+    carat = stanza_end + 1;
+    return true;
+  };
 
-    m_path = (replacements.count(component::Path))
-      ? replacements.at(component::Path) : other.m_path;
+  void init_query_dictionary() const
+  {
+    m_query_index.clear();
+    std::string_view const query = get_query();
+    if (!query.empty())
+    {
+      size_t carat = 0;
+      query_entry entry;
+      while (next_query_parameter(query, m_separator, carat, entry))
+      {
+        m_query_index.push_back(entry);
+      }
+    }
+    m_query_indexed = true;
+  }
 
-    m_content = (replacements.count(component::Content))
-      ? replacements.at(component::Content) : other.m_content;
+  // The whole URI in its normalized form, and where each component lies in it.
+  std::pmr::string m_text;
+  component_table m_components;
 
-    m_query = (replacements.count(component::Query))
-      ? replacements.at(component::Query) : other.m_query;
+  // Built lazily by get_query_dictionary(); as with any other lazily-built
+  // cache, the first call must not race with another on the same object.
+  mutable std::pmr::vector<query_entry> m_query_index;
+  mutable bool m_query_indexed = false;
+  query_argument_separator m_separator;
+};
 
-    m_fragment = (replacements.count(component::Fragment))
-      ? replacements.at(component::Fragment) : other.m_fragment;
-  }
+// A non-owning, parsed view of a URI. Rather than copying each component out
+// into its own string, a uri_view records where each one lies within the
+// supplied text, so the text must outlive the view. The getters behave as they
+// do on uri, but return views into the original text; construct a uri from the
+// view when an owning copy is needed.
+class uri_view
+{
+public:
 
-  // Copy constructor; just use the copy assignment operator internally.
-  uri(uri const &other)
+  using scheme_category = uri::scheme_category;
+  using component = uri::component;
+  using known_scheme = uri::known_scheme;
+  using host_type = uri::host_type;
+  using query_argument_separator = uri::query_argument_separator;
+  using path_segment_range = uri::path_segment_range;
+
+  // An empty view, with every component empty.
+  constexpr uri_view() noexcept :
+    m_text(),
+    m_components(),
+    m_separator(query_argument_separator::ampersand)
+  { };
+
+  // Usable in constant expressions: a constexpr uri_view is parsed at compile
+  // time (see uri_literal below).
+  constexpr uri_view(std::string_view uri_text, scheme_category category = scheme_category::Hierarchical,
+                     query_argument_separator separator = query_argument_separator::ampersand) :
+    m_text(uri_text),
+    m_components(),
+    m_separator(separator)
   {
-    *this = other;
+    m_components.category = category;
+    size_t cursor;
+    uri::parse_error const error = uri::parse_components(uri_text, m_components, cursor);
+    if (error != uri::parse_error::none)
+    {
+      throw std::invalid_argument(uri::describe_failure(error, uri_text));
+    }
   };
 
-  // Copy assignment operator
-  uri &operator=(uri const &other)
+  // Parses a view without throwing on malformed input; see uri::try_parse.
+  static constexpr uri::parse_result<uri_view> try_parse(std::string_view uri_text,
+                                                         scheme_category category = scheme_category::Hierarchical,
+                                                         query_argument_separator separator = query_argument_separator::ampersand) noexcept
   {
-    if (this != &other)
+    uri_view view(uri_text, separator);
+    view.m_components.category = category;
+    size_t cursor;
+    uri::parse_error const error = uri::parse_components(uri_text, view.m_components, cursor);
+    if (error != uri::parse_error::none)
     {
-      m_scheme = other.m_scheme;
-      m_content = other.m_content;
-      m_username = other.m_username;
-      m_password = other.m_password;
-      m_host = other.m_host;
-      m_path = other.m_path;
-      m_query = other.m_query;
-      m_fragment = other.m_fragment;
-      m_query_dict = other.m_query_dict;
-      m_category = other.m_category;
-      m_port = other.m_port;
-      m_path_is_rooted = other.m_path_is_rooted;
-      m_separator = other.m_separator;
+      return uri::parse_result<uri_view>(error, cursor);
     }
-    return *this;
-  }
+    return uri::parse_result<uri_view>(view);
+  };
 
-  ~uri() { };
+  constexpr std::string_view get_scheme() const
+  {
+    return get_component(component::Scheme);
+  };
 
-  std::string const &get_scheme() const
+  constexpr scheme_category get_scheme_category() const
   {
-    return m_scheme;
+    return m_components.category;
   };
 
-  scheme_category get_scheme_category() const
+  constexpr known_scheme get_known_scheme() const noexcept
   {
-    return m_category;
+    return m_components.scheme;
   };
 
-  std::string const &get_content() const
+  constexpr std::string_view get_content() const
   {
-    if (m_category != scheme_category::NonHierarchical)
+    if (m_components.category != scheme_category::NonHierarchical)
     {
       throw std::domain_error("The content component is only valid for non-hierarchical URIs.");
     }
-    return m_content;
+    return get_component(component::Content);
   };
 
-  std::string const &get_username() const
+  constexpr std::string_view get_username() const
   {
-    if (m_category != scheme_category::Hierarchical)
+    if (m_components.category != scheme_category::Hierarchical)
     {
       throw std::domain_error("The username component is only valid for hierarchical URIs.");
     }
-    return m_username;
+    return get_component(component::Username);
   };
 
-  std::string const &get_password() const
+  constexpr std::string_view get_password() const
   {
-    if (m_category != scheme_category::Hierarchical)
+    if (m_components.category != scheme_category::Hierarchical)
     {
       throw std::domain_error("The password component is only valid for hierarchical URIs.");
     }
-    return m_password;
+    return get_component(component::Password);
   };
 
-  std::string const &get_host() const
+  constexpr std::string_view get_host() const
   {
-    if (m_category != scheme_category::Hierarchical)
+    if (m_components.category != scheme_category::Hierarchical)
     {
       throw std::domain_error("The host component is only valid for hierarchical URIs.");
     }
-    return m_host;
-  };
-
-  unsigned long get_port() const
-  {
-    if (m_category != scheme_category::Hierarchical)
-    {
-      throw std::domain_error("The port component is only valid for hierarchical URIs.");
-    }
-    return m_port;
+    return get_component(component::Host);
   };
 
-  std::string const &get_path() const
+  constexpr host_type get_host_type() const
   {
-    if (m_category != scheme_category::Hierarchical)
+    if (m_components.category != scheme_category::Hierarchical)
     {
-      throw std::domain_error("The path component is only valid for hierarchical URIs.");
+      throw std::domain_error("The host component is only valid for hierarchical URIs.");
     }
-    return m_path;
+    return m_components.host;
   };
 
-  std::string const &get_query() const
+  // As on uri.
+  constexpr std::optional<std::array<std::uint8_t, 4>> get_ipv4_address() const noexcept
   {
-    return m_query;
+    return uri::ipv4_address(get_component(component::Host), m_components.host);
   };
 
-  std::map<std::string, std::string> const &get_query_dictionary() const
+  constexpr std::optional<std::array<std::uint8_t, 16>> get_ipv6_address() const noexcept
   {
-    return m_query_dict;
+    return uri::ipv6_address(get_component(component::Host), m_components.host);
   };
 
-  std::string const &get_fragment() const
+  constexpr std::string_view get_zone_id() const noexcept
   {
-    return m_fragment;
+    return uri::zone_id(get_component(component::Host), m_components.host);
   };
 
-  std::string to_string() const
+  constexpr unsigned long get_port() const
   {
-    std::string full_uri;
-    full_uri.append(m_scheme);
-    full_uri.append(":");
-
-    if (m_category == scheme_category::Hierarchical)
-    {
-      full_uri.append("//");
-      if (!(m_username.empty() || m_password.empty()))
-      {
-        full_uri.append(m_username);
-        full_uri.append(":");
-        full_uri.append(m_password);
-        full_uri.append("@");
-      }
-
-      full_uri.append(m_host);
-
-      if (m_port != 0)
-      {
-        full_uri.append(":");
-        full_uri.append(std::to_string(m_port));
-      }
-    }
-    else
-    {
-      full_uri.append(m_content);
-    }
-
-    if (m_path_is_rooted)
+    if (m_components.category != scheme_category::Hierarchical)
     {
-      full_uri.append("/");
-    }
-    full_uri.append(m_path);
-
-    if (!m_query.empty())
-    {
-      full_uri.append("?");
-      full_uri.append(m_query);
+      throw std::domain_error("The port component is only valid for hierarchical URIs.");
     }
+    return m_components.port;
+  };
 
-    if (!m_fragment.empty())
+  constexpr std::string_view get_path() const
+  {
+    if (m_components.category != scheme_category::Hierarchical)
     {
-      full_uri.append("#");
-      full_uri.append(m_fragment);
+      throw std::domain_error("The path component is only valid for hierarchical URIs.");
     }
-
-    return full_uri;
+    return get_component(component::Path);
   };
 
-private:
-
-  void setup(std::string const &uri_text, scheme_category category)
+  constexpr path_segment_range get_path_segments() const
   {
-    size_t const uri_length = uri_text.length();
-
-    if (uri_length == 0)
-    {
-      throw std::invalid_argument("URIs cannot be of zero length.");
-    }
+    return path_segment_range(get_path(), m_components.path_segments, m_components.last_segment);
+  };
 
-    std::string::const_iterator cursor = parse_scheme(uri_text,
-                                                      uri_text.begin());
-    // After calling parse_scheme, *cursor == ':'; none of the following parsers
-    // expect a separator character, so we advance the cursor upon calling them.
-    cursor = parse_content(uri_text, (cursor + 1));
+  constexpr std::string_view get_query() const
+  {
+    return get_component(component::Query);
+  };
 
-    if ((cursor != uri_text.end()) && (*cursor == '?'))
-    {
-      cursor = parse_query(uri_text, (cursor + 1));
-    }
+  constexpr std::string_view get_fragment() const
+  {
+    return get_component(component::Fragment);
+  };
 
-    if ((cursor != uri_text.end()) && (*cursor == '#'))
+  // Scans the query for the first parameter with the given key; unlike uri,
+  // a view keeps no index, so each call scans the query again.
+  constexpr std::optional<std::string_view> find_query_param(std::string_view key) const noexcept
+  {
+    std::string_view const query = get_component(component::Query);
+    if (!query.empty())
     {
-      cursor = parse_fragment(uri_text, (cursor + 1));
+      size_t carat = 0;
+      uri::query_entry entry;
+      while (uri::next_query_parameter(query, m_separator, carat, entry))
+      {
+        if (query.substr(entry.key_offset, entry.key_length) == key)
+        {
+          return query.substr(entry.value_offset, entry.value_length);
+        }
+      }
     }
-
-    init_query_dictionary(); // If the query string is empty, this will be empty too.
-
+    return std::nullopt;
   };
 
-  std::string::const_iterator parse_scheme(std::string const &uri_text,
-					   std::string::const_iterator scheme_start)
+  // As on uri, scanning the query as find_query_param does.
+  std::optional<std::string> find_decoded_query_param(std::string_view key) const
   {
-    std::string::const_iterator scheme_end = scheme_start;
-    while ((scheme_end != uri_text.end()) && (*scheme_end != ':'))
+    std::string_view const query = get_component(component::Query);
+    if (!query.empty())
     {
-      if (!(std::isalnum(*scheme_end) || (*scheme_end == '-')
-	    || (*scheme_end == '+') || (*scheme_end == '.')))
+      size_t carat = 0;
+      uri::query_entry entry;
+      std::string decoded_key;
+      while (uri::next_query_parameter(query, m_separator, carat, entry))
       {
-	throw std::invalid_argument("Invalid character found in the scheme component. Supplied URI was: \""
-				    + uri_text + "\".");
+        std::string_view const parameter_key = query.substr(entry.key_offset, entry.key_length);
+        bool const encoded = uri::needs_query_decoding(parameter_key);
+        if (encoded)
+        {
+          uri::decode_component(parameter_key, decoded_key, true);
+        }
+        if (encoded ? (decoded_key == key) : (parameter_key == key))
+        {
+          return uri::decode_component(query.substr(entry.value_offset, entry.value_length), true);
+        }
       }
-      ++scheme_end;
     }
+    return std::nullopt;
+  };
 
-    if (scheme_end == uri_text.end())
-    {
-      throw std::invalid_argument("End of URI found while parsing the scheme. Supplied URI was: \""
-				  + uri_text + "\".");
-    }
+private:
 
-    if (scheme_start == scheme_end)
-    {
-      throw std::invalid_argument("Scheme component cannot be zero-length. Supplied URI was: \""
-				  + uri_text + "\".");
-    }
+  friend class uri;
+  friend class uri_resolver;
+  friend class uri_router;
 
-    m_scheme = std::string(scheme_start, scheme_end);
-    return scheme_end;
-  };
+  // Only used by try_parse and uri_resolver, which fill in the components
+  // themselves.
+  constexpr uri_view(std::string_view uri_text, query_argument_separator separator) noexcept :
+    m_text(uri_text),
+    m_components(),
+    m_separator(separator)
+  { };
 
-  std::string::const_iterator parse_content(std::string const &uri_text,
-					    std::string::const_iterator content_start)
+  constexpr std::string_view get_component(component which) const
   {
-    std::string::const_iterator content_end = content_start;
-    while ((content_end != uri_text.end()) && (*content_end != '?') && (*content_end != '#'))
-    {
-      ++content_end;
-    }
-
-    m_content = std::string(content_start, content_end);
+    uri::component_span const &span = m_components.spans[static_cast<size_t>(which)];
+    return m_text.substr(span.offset, span.length);
+  };
 
-    if ((m_category == scheme_category::Hierarchical) && (m_content.length() > 0))
-    {
-      // If it's a hierarchical URI, the content should be parsed for the hierarchical components.
-      std::string::const_iterator path_start = m_content.begin();
-      std::string::const_iterator path_end = m_content.end();
-      if (!m_content.compare(0, 2, "//"))
-      {
-	// In this case an authority component is present.
-	std::string::const_iterator authority_cursor = (m_content.begin() + 2);
-	if (m_content.find_first_of('@') != std::string::npos)
-	{
-	  std::string::const_iterator userpass_divider = parse_username(uri_text,
-									m_content,
-									authority_cursor);
-	  authority_cursor = parse_password(uri_text, m_content, (userpass_divider + 1));
-	  // After this call, *authority_cursor == '@', so we skip over it.
-	  ++authority_cursor;
-	}
+  std::string_view m_text;
+  uri::component_table m_components;
+  query_argument_separator m_separator;
+};
 
-	authority_cursor = parse_host(uri_text, m_content, authority_cursor);
+// Parses a URI at compile time, so that a malformed literal fails to build
+// rather than throwing at startup:
+//   constexpr uri_view endpoint = uri_literal("https://api.example.com/v1");
+//   static_assert(endpoint.get_host() == "api.example.com");
+// The component table is computed by the compiler, and as the getters are
+// constexpr, they cost no more than reading a string_view at run time.
+namespace uri_detail
+{
+  // Deliberately not constexpr: reaching it during constant evaluation is what
+  // fails the build, and the compiler's diagnostic names it.
+  inline void malformed_uri_literal(uri::parse_error, size_t)
+  { }
+}
+
+consteval uri_view uri_literal(std::string_view uri_text,
+                               uri::scheme_category category = uri::scheme_category::Hierarchical,
+                               uri::query_argument_separator separator = uri::query_argument_separator::ampersand)
+{
+  uri::parse_result<uri_view> const parsed = uri_view::try_parse(uri_text, category, separator);
+  if (!parsed)
+  {
+    uri_detail::malformed_uri_literal(parsed.error(), parsed.error_offset());
+  }
+  return *parsed;
+}
 
-	if ((authority_cursor != m_content.end()) && (*authority_cursor == ':'))
-	{
-	  authority_cursor = parse_port(uri_text, m_content, (authority_cursor + 1));
-	}
+namespace uri_literals
+{
+  // "https://api.example.com/v1"_uri is uri_literal("https://api.example.com/v1").
+  consteval uri_view operator""_uri(char const *uri_text, size_t length)
+  {
+    return uri_literal(std::string_view(uri_text, length));
+  }
+}
 
-	if ((authority_cursor != m_content.end()) && (*authority_cursor == '/' ))
-	{
-	  // Then the path is rooted, and we should note this.
-	  m_path_is_rooted = true;
-	  path_start = authority_cursor + 1;
-	}
+// Resolves references against a single base URI, such as the links found on
+// one page. The base is parsed once, up front, and each target is written
+// into a buffer supplied by the caller; once that buffer and the resolver's
+// own scratch space have grown to fit, resolving a reference doesn't allocate.
+class uri_resolver
+{
+public:
 
-	// If we've reached the end and no path is present then set path_start
-        // to the end.
-        if (authority_cursor == m_content.end()) {
-          path_start = m_content.end();
-        }
-      }
-      else if (!m_content.compare(0, 1, "/"))
-      {
-	m_path_is_rooted = true;
-	++path_start;
-      }
+  explicit uri_resolver(uri base) :
+    m_base(std::move(base)),
+    m_path_buffer()
+  { };
 
-      // We can now build the path based on what remains in the content string,
-      // since that's all that exists after the host and optional port component.
-      m_path = std::string(path_start, path_end);
-    }
-    return content_end;
+  uri const &base() const noexcept
+  {
+    return m_base;
   };
 
-  std::string::const_iterator parse_username(std::string const &uri_text,
-					     std::string const &content,
-					     std::string::const_iterator username_start)
+  // Resolves reference into out, returning a view of the target over out,
+  // which stays valid until out is next modified. Throws std::invalid_argument
+  // as uri::resolve does.
+  uri_view resolve(std::string_view reference, std::string &out)
   {
-    std::string::const_iterator username_end = username_start;
-    // Since this is only reachable when '@' was in the content string, we can
-    // ignore the end-of-string case.
-    while (*username_end != ':')
+    uri::parse_result<uri_view> const target = try_resolve(reference, out);
+    if (!target)
     {
-      if (*username_end == '@')
-      {
-	throw std::invalid_argument("Username must be followed by a password. Supplied URI was: \""
-				    + uri_text + "\".");
-      }
-      ++username_end;
+      throw std::invalid_argument(uri::describe_failure(target.error(), reference));
     }
-    m_username = std::string(username_start, username_end);
-    return username_end;
+    return *target;
   };
 
-  std::string::const_iterator parse_password(std::string const &uri_text,
-					     std::string const &content,
-					     std::string::const_iterator password_start)
+  // Resolves without throwing on a malformed reference; rather than throwing,
+  // the result carries the error and where in the reference it stopped.
+  uri::parse_result<uri_view> try_resolve(std::string_view reference, std::string &out)
   {
-    std::string::const_iterator password_end = password_start;
-    while (*password_end != '@')
+    uri_view target(std::string_view(), m_base.m_separator);
+    size_t cursor;
+    uri::parse_error const error = uri::resolve_reference(m_base, reference, m_path_buffer,
+                                                          out, target.m_components, cursor);
+    if (error != uri::parse_error::none)
     {
-      ++password_end;
+      return uri::parse_result<uri_view>(error, cursor);
     }
-
-    m_password = std::string(password_start, password_end);
-    return password_end;
+    target.m_text = out;
+    return uri::parse_result<uri_view>(target);
   };
 
-  std::string::const_iterator parse_host(std::string const &uri_text,
-					 std::string const &content,
-					 std::string::const_iterator host_start)
-  {
-    std::string::const_iterator host_end = host_start;
-    // So, the host can contain a few things. It can be a domain, it can be an
-    // IPv4 address, it can be an IPv6 address, or an IPvFuture literal. In the
-    // case of those last two, it's of the form [...] where what's between the
-    // brackets is a matter of which IPv?? version it is.
-    while (host_end != content.end())
-    {
-      if (*host_end == '[')
-      {
-	// We're parsing an IPv6 or IPvFuture address, so we should handle that
-	// instead of the normal procedure.
-	while ((host_end != content.end()) && (*host_end != ']'))
-	{
-	  ++host_end;
-	}
-
-	if (host_end == content.end())
-	{
-	  throw std::invalid_argument("End of content component encountered "
-				      "while parsing the host component. "
-				      "Supplied URI was: \""
-				      + uri_text + "\".");
-	}
-
-	++host_end;
-	break;
-	// We can stop looping, we found the end of the IP literal, which is the
-	// whole of the host component when one's in use.
-      }
-      else if ((*host_end == ':') || (*host_end == '/'))
-      {
-	break;
-      }
-      else
-      {
-	++host_end;
-      }
-    }
+private:
 
-    m_host = std::string(host_start, host_end);
-    return host_end;
-  };
+  uri m_base;
+  std::string m_path_buffer;
+};
 
-  std::string::const_iterator parse_port(std::string const &uri_text,
-					std::string const &content,
-					std::string::const_iterator port_start)
-  {
-    std::string::const_iterator port_end = port_start;
-    while ((port_end != content.end()) && (*port_end != '/'))
-    {
-      if (!std::isdigit(*port_end))
-      {
-	throw std::invalid_argument("Invalid character while parsing the port. "
-				    "Supplied URI was: \"" + uri_text + "\".");
-      }
+// Containers only ask that move construction not throw. Move assignment can
+// allocate when the two uris use different memory resources, and so isn't
+// noexcept.
+static_assert(std::is_nothrow_move_constructible<uri>::value,
+              "uri must be nothrow move-constructible so that containers move rather than copy it.");
 
-      ++port_end;
-    }
+inline uri::uri(uri_view const &view) :
+  m_separator(view.m_separator)
+{
+  assign(view.m_text, view.m_components);
+}
 
-    m_port = std::stoul(std::string(port_start, port_end));
-    return port_end;
-  };
+inline uri::uri(std::allocator_arg_t, allocator_type const &allocator, uri_view const &view) :
+  m_text(allocator),
+  m_query_index(allocator),
+  m_separator(view.m_separator)
+{
+  assign(view.m_text, view.m_components);
+}
 
-  std::string::const_iterator parse_query(std::string const &uri_text,
-                                          std::string::const_iterator query_start)
+template <>
+struct std::hash<uri>
+{
+  size_t operator()(uri const &key) const noexcept
   {
-    std::string::const_iterator query_end = query_start;
-    while ((query_end != uri_text.end()) && (*query_end != '#'))
-    {
-      // Queries can contain almost any character except hash, which is reserved
-      // for the start of the fragment.
-      ++query_end;
-    }
-    m_query = std::string(query_start, query_end);
-    return query_end;
+    return key.hash();
   };
+};
 
-  std::string::const_iterator parse_fragment(std::string const &uri_text,
-                                             std::string::const_iterator fragment_start)
+// Formats a uri as its text, accepting the same format specifications as a
+// string does (such as a width and alignment).
+#if defined(__cpp_lib_format)
+template <>
+struct std::formatter<uri, char> : std::formatter<std::string_view, char>
+{
+  template <typename FormatContext>
+  auto format(uri const &value, FormatContext &context) const
   {
-    m_fragment = std::string(fragment_start, uri_text.end());
-    return uri_text.end();
+    return std::formatter<std::string_view, char>::format(value.to_string_view(), context);
   };
+};
+#endif
 
-  void init_query_dictionary()
+#if defined(URI_USE_FMT)
+template <>
+struct fmt::formatter<uri, char> : fmt::formatter<std::string_view, char>
+{
+  template <typename FormatContext>
+  auto format(uri const &value, FormatContext &context) const
   {
-    if (!m_query.empty())
-    {
-      // Loop over the query string looking for '&'s, then check each one for
-      // an '=' to find keys and values; if there's not an '=' then the key
-      // will have an empty value in the map.
-      char separator = (m_separator == query_argument_separator::ampersand) ? '&' : ';';
-      size_t carat = 0;
-      size_t stanza_end = m_query.find_first_of(separator);
-      do
-      {
-	std::string stanza = m_query.substr(carat, ((stanza_end != std::string::npos) ? (stanza_end - carat) : std::string::npos));
-	size_t key_value_divider = stanza.find_first_of('=');
-	std::string key = stanza.substr(0, key_value_divider);
-	std::string value;
-	if (key_value_divider != std::string::npos)
-	{
-	  value = stanza.substr((key_value_divider + 1));
-	}
-
-	if (m_query_dict.count(key) != 0)
-	{
-	  throw std::invalid_argument("Bad key in the query string!");
-	}
-
-	m_query_dict.emplace(key, value);
-	carat = ((stanza_end != std::string::npos) ? (stanza_end + 1)
-		 : std::string::npos);
-	stanza_end = m_query.find_first_of(separator, carat);
-      }
-      while ((stanza_end != std::string::npos)
-	     || (carat != std::string::npos));
-    }
-  }
-
-  std::string m_scheme;
-  std::string m_content;
-  std::string m_username;
-  std::string m_password;
-  std::string m_host;
-  std::string m_path;
-  std::string m_query;
-  std::string m_fragment;
-
-  std::map<std::string, std::string> m_query_dict;
-
-  scheme_category m_category;
-  unsigned long m_port;
-  bool m_path_is_rooted;
-  query_argument_separator m_separator;
+    return fmt::formatter<std::string_view, char>::format(value.to_string_view(), context);
+  };
 };
+#endif
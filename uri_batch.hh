@@ -0,0 +1,283 @@
+// Copyright (C) 2015 Ben Lewis <benjf5+github@gmail.com>
+// Licensed under the MIT license.
+
+#pragma once
+#include "uri.hh"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for splitting batches of URIs between. The
+// threads sleep between batches, so one pool can be kept for the life of a
+// program and handed to each call to parse_batch.
+class uri_thread_pool
+{
+public:
+
+  // The calling thread also takes part in each batch, so a pool of n threads
+  // parses with n + 1.
+  explicit uri_thread_pool(size_t thread_count = (std::max(std::thread::hardware_concurrency(), 1u) - 1)) :
+    m_body(nullptr),
+    m_next_chunk(0),
+    m_chunk_count(0),
+    m_active(0),
+    m_generation(0),
+    m_stopping(false)
+  {
+    m_threads.reserve(thread_count);
+    for (size_t index = 0; index < thread_count; ++index)
+    {
+      m_threads.emplace_back([this]() { work(); });
+    }
+  };
+
+  uri_thread_pool(uri_thread_pool const &) = delete;
+  uri_thread_pool &operator=(uri_thread_pool const &) = delete;
+
+  ~uri_thread_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::thread &thread : m_threads)
+    {
+      thread.join();
+    }
+  };
+
+  size_t size() const noexcept
+  {
+    return m_threads.size();
+  };
+
+  // Calls body(chunk) for every chunk in [0, chunk_count), spread across the
+  // pool's threads and the calling thread, and returns once all of them have
+  // finished. Threads claim chunks one at a time, so uneven chunks balance out.
+  void run(size_t chunk_count, std::function<void(size_t)> const &body)
+  {
+    std::lock_guard<std::mutex> run_lock(m_run_mutex);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_body = &body;
+      m_chunk_count = chunk_count;
+      m_next_chunk.store(0, std::memory_order_relaxed);
+      m_active = m_threads.size();
+      ++m_generation;
+    }
+    m_wake.notify_all();
+
+    drain(body, chunk_count);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_active == 0; });
+    m_body = nullptr;
+  };
+
+private:
+
+  void drain(std::function<void(size_t)> const &body, size_t chunk_count)
+  {
+    for (size_t chunk = m_next_chunk.fetch_add(1, std::memory_order_relaxed);
+         chunk < chunk_count;
+         chunk = m_next_chunk.fetch_add(1, std::memory_order_relaxed))
+    {
+      body(chunk);
+    }
+  };
+
+  void work()
+  {
+    size_t seen_generation = 0;
+    while (true)
+    {
+      std::function<void(size_t)> const *body;
+      size_t chunk_count;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock, [&]() { return m_stopping || (m_generation != seen_generation); });
+        if (m_stopping)
+        {
+          return;
+        }
+        seen_generation = m_generation;
+        body = m_body;
+        chunk_count = m_chunk_count;
+      }
+
+      drain(*body, chunk_count);
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (--m_active == 0)
+      {
+        m_done.notify_one();
+      }
+    }
+  };
+
+  std::vector<std::thread> m_threads;
+  std::mutex m_run_mutex;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  std::function<void(size_t)> const *m_body;
+  std::atomic<size_t> m_next_chunk;
+  size_t m_chunk_count;
+  size_t m_active;
+  size_t m_generation;
+  bool m_stopping;
+};
+
+struct parse_batch_options
+{
+  uri::scheme_category category = uri::scheme_category::Hierarchical;
+  uri::query_argument_separator separator = uri::query_argument_separator::ampersand;
+  // When null, the batch is parsed on the calling thread alone.
+  uri_thread_pool *pool = nullptr;
+  // The number of inputs each thread claims at a time.
+  size_t chunk_size = 4096;
+};
+
+// The results of parse_batch, stored as a structure of arrays: one column of
+// parsed views and one each of error codes and error offsets, indexed the same
+// way as the batch's input. The views point into the input text, which must
+// outlive them. Size the batch up front and reuse it between calls so that
+// parsing never allocates.
+class uri_batch
+{
+public:
+
+  explicit uri_batch(size_t count = 0) :
+    m_views(count),
+    m_errors(count, uri::parse_error::none),
+    m_error_offsets(count, 0)
+  { };
+
+  // size() is that of the views, so they're resized last: if growing an
+  // array throws, the batch keeps its old size.
+  void resize(size_t count)
+  {
+    m_error_offsets.resize(count, 0);
+    m_errors.resize(count, uri::parse_error::none);
+    m_views.resize(count);
+  };
+
+  size_t size() const noexcept
+  {
+    return m_views.size();
+  };
+
+  // The parsed URI; an empty view if parsing failed.
+  uri_view const &view(size_t index) const noexcept
+  {
+    return m_views[index];
+  };
+
+  uri::parse_error error(size_t index) const noexcept
+  {
+    return m_errors[index];
+  };
+
+  size_t error_offset(size_t index) const noexcept
+  {
+    return m_error_offsets[index];
+  };
+
+  std::span<uri_view const> views() const noexcept
+  {
+    return m_views;
+  };
+
+  std::span<uri::parse_error const> errors() const noexcept
+  {
+    return m_errors;
+  };
+
+  std::span<std::uint32_t const> error_offsets() const noexcept
+  {
+    return m_error_offsets;
+  };
+
+  // The bytes taken by the batch's arrays.
+  size_t memory_usage() const noexcept
+  {
+    return sizeof(*this) + (m_views.capacity() * sizeof(uri_view))
+      + (m_errors.capacity() * sizeof(uri::parse_error)) + (m_error_offsets.capacity() * sizeof(std::uint32_t));
+  };
+
+private:
+
+  friend size_t parse_batch(std::span<std::string_view const> inputs, uri_batch &output,
+                            parse_batch_options const &options);
+
+  std::vector<uri_view> m_views;
+  std::vector<uri::parse_error> m_errors;
+  std::vector<std::uint32_t> m_error_offsets;
+};
+
+// Parses every input into the matching slot of output, which is resized first
+// if it's too small, and returns the number of inputs that failed to parse.
+// Each thread writes only to the slots of the chunks it claims, and parsing a
+// view never allocates, so threads share nothing but the chunk counter.
+inline size_t parse_batch(std::span<std::string_view const> inputs, uri_batch &output,
+                          parse_batch_options const &options = parse_batch_options())
+{
+  if (output.size() < inputs.size())
+  {
+    output.resize(inputs.size());
+  }
+
+  size_t const chunk_size = std::max<size_t>(options.chunk_size, 1);
+  size_t const chunk_count = (inputs.size() + chunk_size - 1) / chunk_size;
+  std::vector<size_t> failures(chunk_count, 0);
+
+  std::function<void(size_t)> const parse_chunk = [&](size_t chunk) {
+    size_t const begin = chunk * chunk_size;
+    size_t const end = std::min((begin + chunk_size), inputs.size());
+    size_t chunk_failures = 0;
+    for (size_t index = begin; index < end; ++index)
+    {
+      uri::parse_result<uri_view> const result = uri_view::try_parse(inputs[index], options.category,
+                                                                     options.separator);
+      output.m_errors[index] = result.error();
+      output.m_error_offsets[index] = static_cast<std::uint32_t>(result.error_offset());
+      if (result)
+      {
+        output.m_views[index] = *result;
+      }
+      else
+      {
+        output.m_views[index] = uri_view();
+        ++chunk_failures;
+      }
+    }
+    failures[chunk] = chunk_failures;
+  };
+
+  if ((options.pool != nullptr) && (options.pool->size() > 0) && (chunk_count > 1))
+  {
+    options.pool->run(chunk_count, parse_chunk);
+  }
+  else
+  {
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk)
+    {
+      parse_chunk(chunk);
+    }
+  }
+
+  size_t total_failures = 0;
+  for (size_t chunk_failures : failures)
+  {
+    total_failures += chunk_failures;
+  }
+  return total_failures;
+}
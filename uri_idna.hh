@@ -0,0 +1,606 @@
+// Copyright (C) 2015 Ben Lewis <benjf5+github@gmail.com>
+// Licensed under the MIT license.
+
+#pragma once
+#include "uri.hh"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace uri_detail
+{
+  // Whether every byte of the text is ASCII. Hosts are almost always plain
+  // ASCII, so this is checked a block at a time, ORing the blocks together
+  // and testing the high bits once at the end.
+  inline bool is_ascii_scalar(char const *text, size_t cursor, size_t length) noexcept
+  {
+    std::uint64_t bits = 0;
+    for (; (cursor + 8) <= length; cursor += 8)
+    {
+      std::uint64_t word;
+      std::memcpy(&word, (text + cursor), 8);
+      bits |= word;
+    }
+    for (; cursor != length; ++cursor)
+    {
+      bits |= static_cast<unsigned char>(text[cursor]);
+    }
+    return (bits & 0x8080808080808080ull) == 0;
+  }
+
+#if defined(URI_HAVE_SSE2)
+  inline bool is_ascii_sse2(char const *text, size_t cursor, size_t length) noexcept
+  {
+    __m128i bits = _mm_setzero_si128();
+    for (; (cursor + 16) <= length; cursor += 16)
+    {
+      bits = _mm_or_si128(bits, _mm_loadu_si128(reinterpret_cast<__m128i const *>(text + cursor)));
+    }
+    return (_mm_movemask_epi8(bits) == 0) && is_ascii_scalar(text, cursor, length);
+  }
+
+  URI_TARGET_AVX2 inline bool is_ascii_avx2(char const *text, size_t cursor, size_t length) noexcept
+  {
+    __m256i bits = _mm256_setzero_si256();
+    for (; (cursor + 32) <= length; cursor += 32)
+    {
+      bits = _mm256_or_si256(bits, _mm256_loadu_si256(reinterpret_cast<__m256i const *>(text + cursor)));
+    }
+    return (_mm256_movemask_epi8(bits) == 0) && is_ascii_sse2(text, cursor, length);
+  }
+#endif
+}
+
+/* Conversion of internationalized host names between their Unicode and ASCII
+ * forms, as IDNA does (RFC 5890 and 5891): each label that holds non-ASCII
+ * characters is Punycode-encoded (RFC 3492) behind an "xn--" prefix. Hosts
+ * are taken as UTF-8, or as percent-encoded UTF-8 as RFC 3986 allows.
+ *
+ * This is done without ICU, and so without the Unicode tables of UTS 46: only
+ * ASCII letters are lowercased, labels aren't NFC-normalized, and code points
+ * aren't checked against the IDNA2008 tables. Hosts that are already
+ * normalized, as most are, convert exactly as a full implementation would
+ * convert them.
+ */
+class idna
+{
+public:
+
+  enum class conversion_error
+  {
+    none,
+    invalid_utf8,
+    invalid_punycode,
+    label_too_long,
+    domain_too_long
+  };
+
+  static char const *describe(conversion_error error) noexcept
+  {
+    switch (error)
+    {
+    case conversion_error::none:
+      return "No error.";
+    case conversion_error::invalid_utf8:
+      return "The host is not valid UTF-8.";
+    case conversion_error::invalid_punycode:
+      return "A label of the host is not valid Punycode.";
+    case conversion_error::label_too_long:
+      return "A label of the host is longer than 63 characters.";
+    case conversion_error::domain_too_long:
+      return "The host is longer than 253 characters.";
+    }
+    return "Unknown error.";
+  };
+
+  static bool is_ascii(std::string_view text) noexcept
+  {
+#if defined(URI_HAVE_SSE2)
+    if (uri_detail::cpu_has_avx2)
+    {
+      return uri_detail::is_ascii_avx2(text.data(), 0, text.length());
+    }
+    return uri_detail::is_ascii_sse2(text.data(), 0, text.length());
+#else
+    return uri_detail::is_ascii_scalar(text.data(), 0, text.length());
+#endif
+  };
+
+  /* Converts a host to its ASCII form, replacing the contents of out: ASCII
+   * letters are lowercased, and each label holding anything else becomes
+   * "xn--" and its Punycode encoding. The ideographic full stops U+3002,
+   * U+FF0E and U+FF61 separate labels as '.' does. A host that's all ASCII
+   * skips the conversion, and its length checks, entirely: it's only
+   * lowercased. An IP literal is copied as it is.
+   */
+  static conversion_error to_ascii(std::string_view host, std::string &out)
+  {
+    out.clear();
+    if (!host.empty() && (host.front() == '['))
+    {
+      out.assign(host);
+      return conversion_error::none;
+    }
+
+    std::string decoded;
+    if (host.find('%') != std::string_view::npos)
+    {
+      uri::decode_component(host, decoded);
+      host = decoded;
+    }
+
+    if (is_ascii(host))
+    {
+      append_lowercase(out, host);
+      return conversion_error::none;
+    }
+
+    out.reserve(host.length() + 16);
+    size_t label_start = 0;
+    size_t cursor = 0;
+    while (true)
+    {
+      size_t const separator = separator_length(host, cursor);
+      if ((separator == 0) && (cursor != host.length()))
+      {
+        ++cursor;
+        continue;
+      }
+
+      conversion_error const error = append_ascii_label(out, host.substr(label_start, (cursor - label_start)));
+      if (error != conversion_error::none)
+      {
+        return error;
+      }
+      if (cursor == host.length())
+      {
+        break;
+      }
+      out.push_back('.');
+      cursor += separator;
+      label_start = cursor;
+    }
+
+    size_t const length = (!out.empty() && (out.back() == '.')) ? (out.length() - 1) : out.length();
+    return (length > 253) ? conversion_error::domain_too_long : conversion_error::none;
+  };
+
+  /* Converts a host to its Unicode form, replacing the contents of out: each
+   * label starting "xn--" is decoded from Punycode into UTF-8, and ASCII
+   * letters elsewhere are lowercased. An IP literal is copied as it is.
+   */
+  static conversion_error to_unicode(std::string_view host, std::string &out)
+  {
+    out.clear();
+    if (!host.empty() && (host.front() == '['))
+    {
+      out.assign(host);
+      return conversion_error::none;
+    }
+
+    out.reserve(host.length());
+    size_t label_start = 0;
+    while (true)
+    {
+      size_t label_end = host.find('.', label_start);
+      if (label_end == std::string_view::npos)
+      {
+        label_end = host.length();
+      }
+
+      std::string_view const label = host.substr(label_start, (label_end - label_start));
+      if ((label.length() > 4) && ((label[0] | 0x20) == 'x') && ((label[1] | 0x20) == 'n')
+          && (label[2] == '-') && (label[3] == '-'))
+      {
+        conversion_error const error = append_unicode_label(out, label.substr(4));
+        if (error != conversion_error::none)
+        {
+          return error;
+        }
+      }
+      else
+      {
+        append_lowercase(out, label);
+      }
+
+      if (label_end == host.length())
+      {
+        break;
+      }
+      out.push_back('.');
+      label_start = label_end + 1;
+    }
+    return conversion_error::none;
+  };
+
+  // The throwing forms of the above; they throw std::invalid_argument.
+  static std::string to_ascii(std::string_view host)
+  {
+    std::string out;
+    conversion_error const error = to_ascii(host, out);
+    if (error != conversion_error::none)
+    {
+      throw std::invalid_argument(describe(error));
+    }
+    return out;
+  };
+
+  static std::string to_unicode(std::string_view host)
+  {
+    std::string out;
+    conversion_error const error = to_unicode(host, out);
+    if (error != conversion_error::none)
+    {
+      throw std::invalid_argument(describe(error));
+    }
+    return out;
+  };
+
+  // Copies a URI with its host converted to the ASCII or Unicode form.
+  // Non-hierarchical URIs, and those without a host, are copied unchanged.
+  static uri with_ascii_host(uri const &value)
+  {
+    if ((value.get_scheme_category() != uri::scheme_category::Hierarchical) || value.get_host().empty())
+    {
+      return value;
+    }
+    return uri(value, { { uri::component::Host, to_ascii(value.get_host()) } });
+  };
+
+  static uri with_unicode_host(uri const &value)
+  {
+    if ((value.get_scheme_category() != uri::scheme_category::Hierarchical) || value.get_host().empty())
+    {
+      return value;
+    }
+    return uri(value, { { uri::component::Host, to_unicode(value.get_host()) } });
+  };
+
+private:
+
+  // The parameters of Punycode's bootstring encoding (RFC 3492 section 5).
+  static constexpr std::uint32_t base = 36;
+  static constexpr std::uint32_t t_min = 1;
+  static constexpr std::uint32_t t_max = 26;
+  static constexpr std::uint32_t skew = 38;
+  static constexpr std::uint32_t damp = 700;
+  static constexpr std::uint32_t initial_bias = 72;
+  static constexpr std::uint32_t initial_n = 128;
+
+  // No label of a valid host has more code points than this.
+  static constexpr size_t max_label_length = 63;
+
+  static void append_lowercase(std::string &out, std::string_view text)
+  {
+    size_t const start = out.length();
+    out.append(text);
+    for (size_t index = start; index < out.length(); ++index)
+    {
+      if ((out[index] >= 'A') && (out[index] <= 'Z'))
+      {
+        out[index] = static_cast<char>(out[index] | 0x20);
+      }
+    }
+  };
+
+  // The length of the label separator at cursor, or 0 if there's none: '.',
+  // or one of the full stops UTS 46 maps to it.
+  static size_t separator_length(std::string_view host, size_t cursor) noexcept
+  {
+    if (cursor == host.length())
+    {
+      return 0;
+    }
+    if (host[cursor] == '.')
+    {
+      return 1;
+    }
+    std::string_view const rest = host.substr(cursor, 3);
+    return ((rest == "\xE3\x80\x82") || (rest == "\xEF\xBC\x8E") || (rest == "\xEF\xBD\xA1")) ? 3 : 0;
+  };
+
+  // Decodes one UTF-8 sequence at cursor, rejecting overlong forms,
+  // surrogates and code points past U+10FFFF.
+  static bool decode_utf8(std::string_view text, size_t &cursor, std::uint32_t &code_point) noexcept
+  {
+    unsigned char const lead = static_cast<unsigned char>(text[cursor]);
+    size_t length = 0;
+    std::uint32_t minimum = 0;
+    if (lead < 0x80)
+    {
+      code_point = lead;
+      ++cursor;
+      return true;
+    }
+    else if ((lead & 0xE0) == 0xC0)
+    {
+      length = 2;
+      minimum = 0x80;
+      code_point = lead & 0x1F;
+    }
+    else if ((lead & 0xF0) == 0xE0)
+    {
+      length = 3;
+      minimum = 0x800;
+      code_point = lead & 0x0F;
+    }
+    else if ((lead & 0xF8) == 0xF0)
+    {
+      length = 4;
+      minimum = 0x10000;
+      code_point = lead & 0x07;
+    }
+    else
+    {
+      return false;
+    }
+
+    if ((cursor + length) > text.length())
+    {
+      return false;
+    }
+    for (size_t index = 1; index < length; ++index)
+    {
+      unsigned char const continuation = static_cast<unsigned char>(text[cursor + index]);
+      if ((continuation & 0xC0) != 0x80)
+      {
+        return false;
+      }
+      code_point = (code_point << 6) | (continuation & 0x3F);
+    }
+    cursor += length;
+    return (code_point >= minimum) && (code_point <= 0x10FFFF)
+      && ((code_point < 0xD800) || (code_point > 0xDFFF));
+  };
+
+  static void append_utf8(std::string &out, std::uint32_t code_point)
+  {
+    if (code_point < 0x80)
+    {
+      out.push_back(static_cast<char>(code_point));
+    }
+    else if (code_point < 0x800)
+    {
+      out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+      out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+    else if (code_point < 0x10000)
+    {
+      out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+    else
+    {
+      out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+  };
+
+  // RFC 3492 section 6.1.
+  static std::uint32_t adapt(std::uint32_t delta, std::uint32_t point_count, bool first_time) noexcept
+  {
+    delta = first_time ? (delta / damp) : (delta / 2);
+    delta += delta / point_count;
+    std::uint32_t k = 0;
+    while (delta > (((base - t_min) * t_max) / 2))
+    {
+      delta /= base - t_min;
+      k += base;
+    }
+    return k + (((base - t_min + 1) * delta) / (delta + skew));
+  };
+
+  static std::uint32_t threshold(std::uint32_t k, std::uint32_t bias) noexcept
+  {
+    return (k <= bias) ? t_min : (k >= (bias + t_max)) ? t_max : (k - bias);
+  };
+
+  static char encode_digit(std::uint32_t digit) noexcept
+  {
+    return static_cast<char>((digit < 26) ? ('a' + digit) : ('0' + (digit - 26)));
+  };
+
+  // A digit's value, in either case; base for anything that isn't a digit.
+  static std::uint32_t decode_digit(char c) noexcept
+  {
+    return ((c >= 'a') && (c <= 'z')) ? static_cast<std::uint32_t>(c - 'a')
+      : ((c >= 'A') && (c <= 'Z')) ? static_cast<std::uint32_t>(c - 'A')
+      : ((c >= '0') && (c <= '9')) ? static_cast<std::uint32_t>(c - '0' + 26) : base;
+  };
+
+  // Appends a label's ASCII form; ASCII labels are only lowercased.
+  static conversion_error append_ascii_label(std::string &out, std::string_view label)
+  {
+    if (is_ascii(label))
+    {
+      if (label.length() > max_label_length)
+      {
+        return conversion_error::label_too_long;
+      }
+      append_lowercase(out, label);
+      return conversion_error::none;
+    }
+
+    std::array<std::uint32_t, max_label_length> code_points{};
+    size_t count = 0;
+    size_t basic_count = 0;
+    for (size_t cursor = 0; cursor < label.length(); ++count)
+    {
+      std::uint32_t code_point = 0;
+      if (!decode_utf8(label, cursor, code_point))
+      {
+        return conversion_error::invalid_utf8;
+      }
+      if (count == max_label_length)
+      {
+        return conversion_error::label_too_long;
+      }
+      if ((code_point >= 'A') && (code_point <= 'Z'))
+      {
+        code_point |= 0x20;
+      }
+      basic_count += (code_point < 0x80) ? 1 : 0;
+      code_points[count] = code_point;
+    }
+
+    // The Punycode encoding of RFC 3492 section 6.3: the basic code points
+    // are copied first, then the insertions of the others are encoded as
+    // variable-length integers, in order of code point.
+    size_t const label_start = out.length();
+    out.append("xn--");
+    for (size_t index = 0; index < count; ++index)
+    {
+      if (code_points[index] < 0x80)
+      {
+        out.push_back(static_cast<char>(code_points[index]));
+      }
+    }
+    if (basic_count > 0)
+    {
+      out.push_back('-');
+    }
+
+    std::uint32_t n = initial_n;
+    std::uint32_t delta = 0;
+    std::uint32_t bias = initial_bias;
+    for (size_t handled = basic_count; handled < count;)
+    {
+      std::uint32_t next = UINT32_MAX;
+      for (size_t index = 0; index < count; ++index)
+      {
+        if ((code_points[index] >= n) && (code_points[index] < next))
+        {
+          next = code_points[index];
+        }
+      }
+
+      // Code points are at most 0x10FFFF and labels at most 63 long, so
+      // delta can't overflow.
+      delta += (next - n) * static_cast<std::uint32_t>(handled + 1);
+      n = next;
+      for (size_t index = 0; index < count; ++index)
+      {
+        if (code_points[index] < n)
+        {
+          ++delta;
+        }
+        else if (code_points[index] == n)
+        {
+          std::uint32_t q = delta;
+          for (std::uint32_t k = base;; k += base)
+          {
+            std::uint32_t const t = threshold(k, bias);
+            if (q < t)
+            {
+              break;
+            }
+            out.push_back(encode_digit(t + ((q - t) % (base - t))));
+            q = (q - t) / (base - t);
+          }
+          out.push_back(encode_digit(q));
+          bias = adapt(delta, static_cast<std::uint32_t>(handled + 1), (handled == basic_count));
+          delta = 0;
+          ++handled;
+        }
+      }
+      ++delta;
+      ++n;
+    }
+
+    return ((out.length() - label_start) > max_label_length) ? conversion_error::label_too_long
+                                                             : conversion_error::none;
+  };
+
+  // Decodes the Punycode of a label (without its "xn--") into UTF-8, as in
+  // RFC 3492 section 6.2.
+  static conversion_error append_unicode_label(std::string &out, std::string_view encoded)
+  {
+    if ((encoded.length() + 4) > max_label_length)
+    {
+      return conversion_error::label_too_long;
+    }
+
+    std::array<std::uint32_t, max_label_length> code_points{};
+    size_t count = 0;
+    size_t const delimiter = encoded.rfind('-');
+    size_t cursor = 0;
+    if (delimiter != std::string_view::npos)
+    {
+      for (; cursor < delimiter; ++cursor)
+      {
+        if (static_cast<unsigned char>(encoded[cursor]) >= 0x80)
+        {
+          return conversion_error::invalid_punycode;
+        }
+        code_points[count++] = static_cast<unsigned char>(encoded[cursor]);
+      }
+      ++cursor;
+    }
+
+    std::uint32_t n = initial_n;
+    std::uint32_t i = 0;
+    std::uint32_t bias = initial_bias;
+    while (cursor < encoded.length())
+    {
+      std::uint32_t const old_i = i;
+      std::uint32_t w = 1;
+      for (std::uint32_t k = base;; k += base)
+      {
+        if (cursor == encoded.length())
+        {
+          return conversion_error::invalid_punycode;
+        }
+        std::uint32_t const digit = decode_digit(encoded[cursor++]);
+        if ((digit >= base) || (digit > ((UINT32_MAX - i) / w)))
+        {
+          return conversion_error::invalid_punycode;
+        }
+        i += digit * w;
+        std::uint32_t const t = threshold(k, bias);
+        if (digit < t)
+        {
+          break;
+        }
+        if (w > (UINT32_MAX / (base - t)))
+        {
+          return conversion_error::invalid_punycode;
+        }
+        w *= base - t;
+      }
+
+      std::uint32_t const point_count = static_cast<std::uint32_t>(count + 1);
+      bias = adapt((i - old_i), point_count, (old_i == 0));
+      if ((i / point_count) > (0x10FFFF - n))
+      {
+        return conversion_error::invalid_punycode;
+      }
+      n += i / point_count;
+      i %= point_count;
+      if (((n >= 0xD800) && (n <= 0xDFFF)) || (count == max_label_length))
+      {
+        return conversion_error::invalid_punycode;
+      }
+
+      for (size_t index = count; index > i; --index)
+      {
+        code_points[index] = code_points[index - 1];
+      }
+      code_points[i++] = n;
+      ++count;
+    }
+
+    for (size_t index = 0; index < count; ++index)
+    {
+      std::uint32_t const code_point = code_points[index];
+      append_utf8(out, ((code_point >= 'A') && (code_point <= 'Z')) ? (code_point | 0x20) : code_point);
+    }
+    return conversion_error::none;
+  };
+};
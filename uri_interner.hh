@@ -0,0 +1,347 @@
+// Copyright (C) 2015 Ben Lewis <benjf5+github@gmail.com>
+// Licensed under the MIT license.
+
+#pragma once
+#include "uri.hh"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Gives each distinct host a 32-bit ID, and keeps one copy of its name for
+ * every URI that shares it. Programs that see the same hosts in many URIs can
+ * keep the ID in place of the host's text, and compare or group URIs by host
+ * with integer operations.
+ *
+ * The table is split into shards by the hash of the host, each with its own
+ * reader/writer lock, so that threads interning different hosts rarely meet
+ * and threads interning a host that is already known only share a lock. Names
+ * never move once interned: the views returned by name() stay valid for the
+ * life of the interner, and name() itself takes no lock.
+ */
+class host_interner
+{
+public:
+
+  using host_id = std::uint32_t;
+
+  // The ID of the empty host, and of URIs that have no host.
+  static constexpr host_id no_host = 0;
+
+  host_interner()
+  {
+    // The empty host is entry 0 of shard 0, so that no_host names it.
+    shard &first = m_shards[0];
+    first.segments[0].store(new std::string_view[first_segment_size], std::memory_order_relaxed);
+    first.count.store(1, std::memory_order_release);
+  };
+
+  host_interner(host_interner const &) = delete;
+  host_interner &operator=(host_interner const &) = delete;
+
+  /* The ID of a host, adding it if it hasn't been seen before. The host is
+   * interned exactly as given; intern_host() below folds the case of a URI's
+   * host first. Throws std::length_error if a shard has run out of IDs.
+   */
+  host_id intern(std::string_view host)
+  {
+    if (host.empty())
+    {
+      return no_host;
+    }
+
+    std::uint64_t const hash = uri_detail::hash_bytes(host.data(), host.length());
+    size_t const shard_index = static_cast<size_t>(hash & (shard_count - 1));
+    std::uint32_t const tag = static_cast<std::uint32_t>(hash >> 32);
+    shard &owner = m_shards[shard_index];
+
+    std::uint32_t local = 0;
+    {
+      std::shared_lock<std::shared_mutex> lock(owner.mutex);
+      if (find_in(owner, host, tag, local))
+      {
+        return make_id(shard_index, local);
+      }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(owner.mutex);
+    if (!find_in(owner, host, tag, local))
+    {
+      local = insert_into(owner, host, tag);
+    }
+    return make_id(shard_index, local);
+  };
+
+  // The ID of a host that has already been interned.
+  std::optional<host_id> find(std::string_view host) const
+  {
+    if (host.empty())
+    {
+      return no_host;
+    }
+
+    std::uint64_t const hash = uri_detail::hash_bytes(host.data(), host.length());
+    size_t const shard_index = static_cast<size_t>(hash & (shard_count - 1));
+    shard const &owner = m_shards[shard_index];
+
+    std::uint32_t local = 0;
+    std::shared_lock<std::shared_mutex> lock(owner.mutex);
+    if (find_in(owner, host, static_cast<std::uint32_t>(hash >> 32), local))
+    {
+      return make_id(shard_index, local);
+    }
+    return std::nullopt;
+  };
+
+  // The host an ID was given to; empty for no_host and for IDs this interner
+  // didn't return.
+  std::string_view name(host_id id) const noexcept
+  {
+    shard const &owner = m_shards[id & (shard_count - 1)];
+    std::uint32_t const local = id >> shard_bits;
+    if (local >= owner.count.load(std::memory_order_acquire))
+    {
+      return std::string_view();
+    }
+    return entry(owner, local);
+  };
+
+  /* The ID of a URI's host, with ASCII letters folded to lowercase so that
+   * hosts differing only in case share an ID. URIs without a host, and those
+   * that aren't hierarchical, get no_host.
+   */
+  host_id intern_host(uri const &value)
+  {
+    return (value.get_scheme_category() == uri::scheme_category::Hierarchical)
+      ? intern_folded(value.get_host()) : no_host;
+  };
+
+  host_id intern_host(uri_view const &value)
+  {
+    return (value.get_scheme_category() == uri::scheme_category::Hierarchical)
+      ? intern_folded(value.get_host()) : no_host;
+  };
+
+  // Parses a URI and interns its host in one step; host is left alone if the
+  // URI is malformed.
+  uri::parse_result<uri_view> try_parse(std::string_view uri_text, host_id &host,
+                                        uri::scheme_category category = uri::scheme_category::Hierarchical)
+  {
+    uri::parse_result<uri_view> result = uri_view::try_parse(uri_text, category);
+    if (result)
+    {
+      host = intern_host(*result);
+    }
+    return result;
+  };
+
+  // The number of distinct hosts interned, not counting the empty host.
+  size_t size() const noexcept
+  {
+    size_t total = 0;
+    for (shard const &owner : m_shards)
+    {
+      total += owner.count.load(std::memory_order_acquire);
+    }
+    return total - 1;
+  };
+
+  // The bytes taken by the interner and every name in it.
+  size_t memory_usage() const
+  {
+    size_t total = sizeof(*this);
+    for (shard const &owner : m_shards)
+    {
+      std::shared_lock<std::shared_mutex> lock(owner.mutex);
+      total += (owner.slots.capacity() * sizeof(std::uint64_t)) + owner.chunk_bytes
+        + (owner.chunks.capacity() * sizeof(std::unique_ptr<char[]>));
+      for (size_t segment = 0; segment < segment_count; ++segment)
+      {
+        if (owner.segments[segment].load(std::memory_order_relaxed) != nullptr)
+        {
+          total += (first_segment_size << segment) * sizeof(std::string_view);
+        }
+      }
+    }
+    return total;
+  };
+
+private:
+
+  // IDs keep the shard in their low bits and the host's index within the
+  // shard above them.
+  static constexpr unsigned shard_bits = 6;
+  static constexpr size_t shard_count = size_t(1) << shard_bits;
+  static constexpr std::uint32_t max_per_shard = std::uint32_t(1) << (32 - shard_bits);
+
+  // A shard's names are listed in segments that double in size, so that the
+  // list can grow without moving what name() may be reading.
+  static constexpr size_t first_segment_size = 64;
+  static constexpr size_t segment_count = 21;
+  static constexpr size_t chunk_size = 16 * 1024;
+
+  struct alignas(64) shard
+  {
+    mutable std::shared_mutex mutex;
+    // Open addressing: each slot holds the upper half of a host's hash and
+    // one more than its index, or zero when empty.
+    std::vector<std::uint64_t> slots;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t chunk_used = chunk_size;
+    size_t chunk_bytes = 0;
+    std::array<std::atomic<std::string_view *>, segment_count> segments{};
+    std::atomic<std::uint32_t> count{ 0 };
+
+    ~shard()
+    {
+      for (std::atomic<std::string_view *> &segment : segments)
+      {
+        delete[] segment.load(std::memory_order_relaxed);
+      }
+    };
+  };
+
+  std::array<shard, shard_count> m_shards;
+
+  static host_id make_id(size_t shard_index, std::uint32_t local) noexcept
+  {
+    return (local << shard_bits) | static_cast<host_id>(shard_index);
+  };
+
+  static size_t segment_of(std::uint32_t local, size_t &offset) noexcept
+  {
+    size_t const segment = static_cast<size_t>(std::bit_width((local / first_segment_size) + 1)) - 1;
+    offset = local - (first_segment_size * ((size_t(1) << segment) - 1));
+    return segment;
+  };
+
+  static std::string_view entry(shard const &owner, std::uint32_t local) noexcept
+  {
+    size_t offset = 0;
+    size_t const segment = segment_of(local, offset);
+    return owner.segments[segment].load(std::memory_order_acquire)[offset];
+  };
+
+  // Called with the shard's lock held, shared or not.
+  static bool find_in(shard const &owner, std::string_view host, std::uint32_t tag,
+                      std::uint32_t &local) noexcept
+  {
+    if (owner.slots.empty())
+    {
+      return false;
+    }
+    size_t const mask = owner.slots.size() - 1;
+    for (size_t position = tag & mask; ; position = (position + 1) & mask)
+    {
+      std::uint64_t const slot = owner.slots[position];
+      if (slot == 0)
+      {
+        return false;
+      }
+      if (static_cast<std::uint32_t>(slot >> 32) == tag)
+      {
+        std::uint32_t const candidate = static_cast<std::uint32_t>(slot) - 1;
+        if (entry(owner, candidate) == host)
+        {
+          local = candidate;
+          return true;
+        }
+      }
+    }
+  };
+
+  static void place(std::vector<std::uint64_t> &slots, std::uint64_t slot) noexcept
+  {
+    size_t const mask = slots.size() - 1;
+    size_t position = static_cast<std::uint32_t>(slot >> 32) & mask;
+    while (slots[position] != 0)
+    {
+      position = (position + 1) & mask;
+    }
+    slots[position] = slot;
+  };
+
+  // Called with the shard's lock held exclusively.
+  static std::uint32_t insert_into(shard &owner, std::string_view host, std::uint32_t tag)
+  {
+    std::uint32_t const local = owner.count.load(std::memory_order_relaxed);
+    if (local == max_per_shard)
+    {
+      throw std::length_error("The host interner has run out of IDs.");
+    }
+
+    // Keep the table at most three-quarters full.
+    if (((static_cast<size_t>(local) + 1) * 4) > (owner.slots.size() * 3))
+    {
+      std::vector<std::uint64_t> grown(std::max<size_t>(owner.slots.size() * 2, 64), 0);
+      for (std::uint64_t const slot : owner.slots)
+      {
+        if (slot != 0)
+        {
+          place(grown, slot);
+        }
+      }
+      owner.slots.swap(grown);
+    }
+
+    if ((chunk_size - owner.chunk_used) < host.length())
+    {
+      size_t const size = std::max(chunk_size, host.length());
+      owner.chunks.push_back(std::make_unique<char[]>(size));
+      owner.chunk_used = (size == chunk_size) ? 0 : chunk_size;
+      owner.chunk_bytes += size;
+    }
+    char *const stored = (host.length() > chunk_size)
+      ? owner.chunks.back().get() : (owner.chunks.back().get() + owner.chunk_used);
+    std::memcpy(stored, host.data(), host.length());
+    if (host.length() <= chunk_size)
+    {
+      owner.chunk_used += host.length();
+    }
+
+    size_t offset = 0;
+    size_t const segment = segment_of(local, offset);
+    std::string_view *names = owner.segments[segment].load(std::memory_order_relaxed);
+    if (names == nullptr)
+    {
+      names = new std::string_view[first_segment_size << segment];
+      owner.segments[segment].store(names, std::memory_order_release);
+    }
+    names[offset] = std::string_view(stored, host.length());
+    place(owner.slots, (std::uint64_t(tag) << 32) | (std::uint64_t(local) + 1));
+    owner.count.store(local + 1, std::memory_order_release);
+    return local;
+  };
+
+  host_id intern_folded(std::string_view host)
+  {
+    size_t index = 0;
+    while ((index < host.length()) && !((host[index] >= 'A') && (host[index] <= 'Z')))
+    {
+      ++index;
+    }
+    if (index == host.length())
+    {
+      return intern(host);
+    }
+
+    std::string folded(host);
+    for (char &c : folded)
+    {
+      if ((c >= 'A') && (c <= 'Z'))
+      {
+        c = static_cast<char>(c | 0x20);
+      }
+    }
+    return intern(folded);
+  };
+};
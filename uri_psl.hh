@@ -0,0 +1,353 @@
+// Copyright (C) 2015 Ben Lewis <benjf5+github@gmail.com>
+// Licensed under the MIT license.
+
+#pragma once
+#include "uri.hh"
+#include "uri_idna.hh"
+#include "uri_reader.hh"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* The public suffix list (https://publicsuffix.org/) names the domains under
+ * which anyone can register a name: "com", "co.uk", "github.io" and so on. A
+ * public_suffix_list compiles the list's rules into a trie of labels, read
+ * from the last label of a host to the first, so finding the public suffix or
+ * registrable domain of a host takes one lookup per label and allocates
+ * nothing. The rules can come from a copy of the list on disk or from text
+ * compiled into the program.
+ */
+class public_suffix_list
+{
+public:
+
+  // An empty list, under which every host's public suffix is its last label.
+  public_suffix_list()
+  {
+    m_nodes.push_back(node{});
+  };
+
+  /* Compiles rules in the format of public_suffix_list.dat: one rule per
+   * line, with "//" starting a comment line, "*." starting a wildcard rule
+   * and "!" an exception. Anything after a rule on its line is ignored.
+   * Internationalized rules match both their Unicode and ASCII forms; a rule
+   * that can't be converted throws std::invalid_argument.
+   */
+  explicit public_suffix_list(std::string_view rules)
+  {
+    builder_node root;
+    std::string ascii;
+    std::string_view line;
+    size_t cursor = 0;
+    while (uri_detail::next_line(rules, cursor, line))
+    {
+      size_t const rule_end = line.find_first_of(" \t");
+      std::string_view rule = line.substr(0, rule_end);
+      if (rule.empty() || (rule.substr(0, 2) == "//"))
+      {
+        continue;
+      }
+
+      add_rule(root, rule);
+      if (!idna::is_ascii(rule))
+      {
+        bool const exception = (rule.front() == '!');
+        bool const wildcard = (rule.substr(0, 2) == "*.");
+        std::string_view const name = rule.substr(exception ? 1 : (wildcard ? 2 : 0));
+        idna::conversion_error const error = idna::to_ascii(name, ascii);
+        if (error != idna::conversion_error::none)
+        {
+          throw std::invalid_argument(idna::describe(error));
+        }
+        ascii.insert(0, (exception ? "!" : (wildcard ? "*." : "")));
+        add_rule(root, ascii);
+      }
+    }
+    compile(root);
+  };
+
+  // Compiles the rules in a file; throws std::system_error if the file can't
+  // be read.
+  static public_suffix_list from_file(char const *path)
+  {
+    mapped_file const file(path);
+    return public_suffix_list(file.contents());
+  };
+
+  /* The public suffix of a registered name: the longest suffix of the host
+   * that a rule matches, or its last label if none does. The host is
+   * compared without regard to ASCII case, and a trailing '.' is left out of
+   * the result. Hosts with empty labels have no public suffix.
+   */
+  std::string_view public_suffix(std::string_view host) const noexcept
+  {
+    host = trim_root(host);
+    size_t suffix_start = 0;
+    size_t domain_start = 0;
+    return match(host, suffix_start, domain_start) ? host.substr(suffix_start) : std::string_view();
+  };
+
+  // The registrable domain of a registered name: its public suffix and the
+  // label before it. A host that is itself a public suffix has none.
+  std::string_view registrable_domain(std::string_view host) const noexcept
+  {
+    host = trim_root(host);
+    size_t suffix_start = 0;
+    size_t domain_start = 0;
+    return (match(host, suffix_start, domain_start) && (domain_start != std::string_view::npos))
+      ? host.substr(domain_start) : std::string_view();
+  };
+
+  // The same, for the host of a URI; the result points into the URI's text,
+  // and is empty unless the URI is hierarchical and its host is a registered
+  // name.
+  std::string_view public_suffix_of(uri const &value) const noexcept
+  {
+    return has_reg_name(value) ? public_suffix(value.get_host()) : std::string_view();
+  };
+
+  std::string_view public_suffix_of(uri_view const &value) const noexcept
+  {
+    return has_reg_name(value) ? public_suffix(value.get_host()) : std::string_view();
+  };
+
+  std::string_view registrable_domain_of(uri const &value) const noexcept
+  {
+    return has_reg_name(value) ? registrable_domain(value.get_host()) : std::string_view();
+  };
+
+  std::string_view registrable_domain_of(uri_view const &value) const noexcept
+  {
+    return has_reg_name(value) ? registrable_domain(value.get_host()) : std::string_view();
+  };
+
+  // The number of labels in the trie, and the bytes it occupies.
+  size_t size() const noexcept
+  {
+    return m_nodes.size() - 1;
+  };
+
+  size_t memory_usage() const noexcept
+  {
+    return sizeof(*this) + (m_nodes.capacity() * sizeof(node)) + m_labels.capacity();
+  };
+
+private:
+
+  // get_host_type() throws for URIs that aren't hierarchical, so check first.
+  template <typename uri_type>
+  static bool has_reg_name(uri_type const &value) noexcept
+  {
+    return (value.get_scheme_category() == uri::scheme_category::Hierarchical)
+      && (value.get_host_type() == uri::host_type::reg_name);
+  };
+
+  enum node_flags : std::uint8_t
+  {
+    rule = 1,           // A rule ends at this label.
+    wildcard_rule = 2,  // A "*." rule ends at this label; any label under it is a suffix.
+    exception_rule = 4  // A "!" rule ends at this label; the suffix is its parent.
+  };
+
+  // The children of each node are stored together, sorted by label, so they
+  // can be binary searched.
+  struct node
+  {
+    std::uint32_t label_offset = 0;
+    std::uint32_t first_child = 0;
+    std::uint32_t child_count = 0;
+    std::uint8_t label_length = 0;
+    std::uint8_t flags = 0;
+  };
+
+  struct builder_node
+  {
+    std::map<std::string, builder_node, std::less<>> children;
+    std::uint8_t flags = 0;
+  };
+
+  std::vector<node> m_nodes;
+  std::string m_labels;
+
+  static char to_lower(char c) noexcept
+  {
+    return ((c >= 'A') && (c <= 'Z')) ? static_cast<char>(c | 0x20) : c;
+  };
+
+  static std::string_view trim_root(std::string_view host) noexcept
+  {
+    return (!host.empty() && (host.back() == '.')) ? host.substr(0, (host.length() - 1)) : host;
+  };
+
+  static void add_rule(builder_node &root, std::string_view rule)
+  {
+    std::uint8_t flag = node_flags::rule;
+    if (rule.front() == '!')
+    {
+      flag = node_flags::exception_rule;
+      rule.remove_prefix(1);
+    }
+    else if (rule.substr(0, 2) == "*.")
+    {
+      flag = node_flags::wildcard_rule;
+      rule.remove_prefix(2);
+    }
+    rule = trim_root(rule);
+
+    builder_node *current = &root;
+    while (!rule.empty())
+    {
+      size_t const dot = rule.rfind('.');
+      std::string label(rule.substr((dot == std::string_view::npos) ? 0 : (dot + 1)));
+      if (label.empty() || (label.length() > 63))
+      {
+        throw std::invalid_argument("A public suffix rule has an empty or overlong label.");
+      }
+      std::transform(label.begin(), label.end(), label.begin(), to_lower);
+      current = &current->children[label];
+      rule = rule.substr(0, ((dot == std::string_view::npos) ? 0 : dot));
+    }
+    current->flags |= flag;
+  };
+
+  // Lays the trie out breadth-first, so every node's children are adjacent.
+  void compile(builder_node const &root)
+  {
+    std::vector<builder_node const *> pending{ &root };
+    m_nodes.push_back(node{});
+    for (size_t index = 0; index < pending.size(); ++index)
+    {
+      builder_node const &current = *pending[index];
+      m_nodes[index].flags = current.flags;
+      m_nodes[index].first_child = static_cast<std::uint32_t>(m_nodes.size());
+      m_nodes[index].child_count = static_cast<std::uint32_t>(current.children.size());
+      for (auto const &[label, child] : current.children)
+      {
+        node compiled;
+        compiled.label_offset = static_cast<std::uint32_t>(m_labels.length());
+        compiled.label_length = static_cast<std::uint8_t>(label.length());
+        m_labels += label;
+        m_nodes.push_back(compiled);
+        pending.push_back(&child);
+      }
+    }
+    m_nodes.shrink_to_fit();
+    m_labels.shrink_to_fit();
+  };
+
+  // Compares a stored, lowercase label with a label of a host.
+  int compare_label(node const &stored, std::string_view label) const noexcept
+  {
+    std::string_view const text(m_labels.data() + stored.label_offset, stored.label_length);
+    size_t const length = std::min(text.length(), label.length());
+    for (size_t index = 0; index < length; ++index)
+    {
+      unsigned char const left = static_cast<unsigned char>(text[index]);
+      unsigned char const right = static_cast<unsigned char>(to_lower(label[index]));
+      if (left != right)
+      {
+        return (left < right) ? -1 : 1;
+      }
+    }
+    return (text.length() == label.length()) ? 0 : ((text.length() < label.length()) ? -1 : 1);
+  };
+
+  node const *find_child(node const &parent, std::string_view label) const noexcept
+  {
+    size_t low = parent.first_child;
+    size_t high = parent.first_child + parent.child_count;
+    while (low < high)
+    {
+      size_t const middle = low + ((high - low) / 2);
+      int const order = compare_label(m_nodes[middle], label);
+      if (order == 0)
+      {
+        return &m_nodes[middle];
+      }
+      if (order < 0)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+    return nullptr;
+  };
+
+  /* Finds where the public suffix of a host starts, and where its
+   * registrable domain starts (npos if the host is a public suffix itself).
+   * Labels are matched against the trie from the last; the longest rule
+   * matched wins, unless an exception rule is matched. Returns false if the
+   * host has an empty label.
+   */
+  bool match(std::string_view host, size_t &suffix_start, size_t &domain_start) const noexcept
+  {
+    if (host.empty())
+    {
+      return false;
+    }
+
+    // The longest suffix so far, in labels; the implicit "*" rule makes any
+    // last label a public suffix.
+    size_t suffix_labels = 1;
+    size_t label_count = 0;
+    size_t previous_start = 0;
+    suffix_start = std::string_view::npos;
+    domain_start = std::string_view::npos;
+    node const *current = m_nodes.data();
+    size_t end = host.length();
+    while (true)
+    {
+      size_t const dot = (end == 0) ? std::string_view::npos : host.rfind('.', (end - 1));
+      size_t const start = (dot == std::string_view::npos) ? 0 : (dot + 1);
+      if (start == end)
+      {
+        return false;
+      }
+      ++label_count;
+
+      // Once the trie has nothing more to match, the suffix is known, and the
+      // rest of the host is only read to check it for empty labels.
+      if (current != nullptr)
+      {
+        if (current->flags & node_flags::wildcard_rule)
+        {
+          suffix_labels = label_count;
+        }
+        current = find_child(*current, host.substr(start, (end - start)));
+        if ((current != nullptr) && (current->flags & node_flags::exception_rule) && (label_count > 1))
+        {
+          suffix_labels = label_count - 1;
+          suffix_start = previous_start;
+          current = nullptr;
+        }
+        else if ((current != nullptr) && (current->flags & node_flags::rule))
+        {
+          suffix_labels = label_count;
+        }
+      }
+
+      if (label_count == suffix_labels)
+      {
+        suffix_start = start;
+        domain_start = std::string_view::npos;
+      }
+      else if (label_count == (suffix_labels + 1))
+      {
+        domain_start = start;
+      }
+      previous_start = start;
+      if (dot == std::string_view::npos)
+      {
+        return true;
+      }
+      end = dot;
+    }
+  };
+};
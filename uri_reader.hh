@@ -0,0 +1,437 @@
+// Copyright (C) 2015 Ben Lewis <benjf5+github@gmail.com>
+// Licensed under the MIT license.
+
+#pragma once
+#include "uri.hh"
+#include "uri_batch.hh"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* These readers parse newline-delimited files of URIs, one URI per line,
+ * without copying each line into a string first. Lines may end in "\n" or
+ * "\r\n", and blank lines are skipped. Every record's line and view point
+ * straight into the reader's input, and are only valid for as long as it is.
+ */
+
+// One line of input and the result of parsing it.
+struct uri_record
+{
+  std::string_view line;
+  uri_view view;
+  uri::parse_error error;
+  size_t error_offset;
+};
+
+namespace uri_detail
+{
+  // Finds the next non-blank line at or after cursor, stripping a trailing
+  // '\r', and moves cursor past its newline; returns false once the text is
+  // exhausted. If require_newline is set, a final line with no newline after
+  // it is left unread.
+  inline bool next_line(std::string_view text, size_t &cursor, std::string_view &line,
+                        bool require_newline = false) noexcept
+  {
+    while (cursor < text.length())
+    {
+      size_t const line_end = find_delimiter<'\n'>(text, cursor);
+      if (require_newline && (line_end == text.length()))
+      {
+        return false;
+      }
+
+      line = text.substr(cursor, (line_end - cursor));
+      cursor = line_end + 1;
+      if (!line.empty() && (line.back() == '\r'))
+      {
+        line.remove_suffix(1);
+      }
+      if (!line.empty())
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  inline void parse_record(std::string_view line, uri::scheme_category category,
+                           uri::query_argument_separator separator, uri_record &record) noexcept
+  {
+    uri::parse_result<uri_view> const result = uri_view::try_parse(line, category, separator);
+    record.line = line;
+    record.error = result.error();
+    record.error_offset = result.error_offset();
+    record.view = result ? *result : uri_view();
+  }
+}
+
+// A pull-style range over the URIs in a buffer holding the whole input, such
+// as a mapped_file's contents:
+//
+//   for (uri_record const &record : uri_line_range(file.contents())) ...
+class uri_line_range
+{
+public:
+
+  class const_iterator
+  {
+  public:
+
+    using iterator_category = std::input_iterator_tag;
+    using value_type = uri_record;
+    using difference_type = std::ptrdiff_t;
+    using pointer = uri_record const *;
+    using reference = uri_record const &;
+
+    const_iterator() noexcept :
+      m_range(nullptr),
+      m_cursor(0)
+    { };
+
+    reference operator*() const noexcept
+    {
+      return m_record;
+    };
+
+    pointer operator->() const noexcept
+    {
+      return &m_record;
+    };
+
+    const_iterator &operator++() noexcept
+    {
+      advance();
+      return *this;
+    };
+
+    const_iterator operator++(int) noexcept
+    {
+      const_iterator previous(*this);
+      advance();
+      return previous;
+    };
+
+    bool operator==(const_iterator const &other) const noexcept
+    {
+      return m_range == other.m_range;
+    };
+
+    bool operator!=(const_iterator const &other) const noexcept
+    {
+      return m_range != other.m_range;
+    };
+
+  private:
+
+    friend class uri_line_range;
+
+    explicit const_iterator(uri_line_range const *range) noexcept :
+      m_range(range),
+      m_cursor(0)
+    {
+      advance();
+    };
+
+    void advance() noexcept
+    {
+      std::string_view line;
+      if (uri_detail::next_line(m_range->m_text, m_cursor, line))
+      {
+        uri_detail::parse_record(line, m_range->m_category, m_range->m_separator, m_record);
+      }
+      else
+      {
+        m_range = nullptr;
+      }
+    };
+
+    uri_line_range const *m_range;
+    size_t m_cursor;
+    uri_record m_record;
+  };
+
+  explicit uri_line_range(std::string_view text,
+                          uri::scheme_category category = uri::scheme_category::Hierarchical,
+                          uri::query_argument_separator separator = uri::query_argument_separator::ampersand) noexcept :
+    m_text(text),
+    m_category(category),
+    m_separator(separator)
+  { };
+
+  const_iterator begin() const noexcept
+  {
+    return const_iterator(this);
+  };
+
+  const_iterator end() const noexcept
+  {
+    return const_iterator();
+  };
+
+private:
+
+  std::string_view m_text;
+  uri::scheme_category m_category;
+  uri::query_argument_separator m_separator;
+};
+
+// Calls callback(record) for each URI in a buffer holding the whole input.
+template <typename Callback>
+void for_each_uri(std::string_view text, Callback &&callback,
+                  uri::scheme_category category = uri::scheme_category::Hierarchical,
+                  uri::query_argument_separator separator = uri::query_argument_separator::ampersand)
+{
+  for (uri_record const &record : uri_line_range(text, category, separator))
+  {
+    callback(record);
+  }
+}
+
+// Splits a buffer holding the whole input into batches of up to batch_size
+// lines, parses each with parse_batch (across options.pool, if set), and calls
+// callback(lines, batch) with the lines and the batch they were parsed into.
+// The batch is reused from one call to the next.
+template <typename Callback>
+void for_each_uri_batch(std::string_view text, size_t batch_size, Callback &&callback,
+                        parse_batch_options const &options = parse_batch_options())
+{
+  std::vector<std::string_view> lines;
+  lines.reserve(batch_size);
+  uri_batch batch(batch_size);
+
+  size_t cursor = 0;
+  std::string_view line;
+  bool more = true;
+  while (more)
+  {
+    lines.clear();
+    while ((lines.size() < batch_size) && (more = uri_detail::next_line(text, cursor, line)))
+    {
+      lines.push_back(line);
+    }
+
+    if (!lines.empty())
+    {
+      parse_batch(lines, batch, options);
+      callback(std::span<std::string_view const>(lines), static_cast<uri_batch const &>(batch));
+    }
+  }
+}
+
+// A read-only memory mapping of a whole file, for handing to uri_line_range
+// or for_each_uri; the mapping is released when this is destroyed.
+class mapped_file
+{
+public:
+
+  explicit mapped_file(char const *path)
+  {
+#if defined(_WIN32)
+    m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                         FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+      throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), path);
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size))
+    {
+      DWORD const error = GetLastError();
+      CloseHandle(m_file);
+      throw std::system_error(static_cast<int>(error), std::system_category(), path);
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+
+    if (m_size > 0)
+    {
+      m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      m_data = m_mapping ? static_cast<char const *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+      if (m_data == nullptr)
+      {
+        DWORD const error = GetLastError();
+        if (m_mapping)
+        {
+          CloseHandle(m_mapping);
+        }
+        CloseHandle(m_file);
+        throw std::system_error(static_cast<int>(error), std::system_category(), path);
+      }
+    }
+#else
+    int const descriptor = ::open(path, O_RDONLY);
+    if (descriptor < 0)
+    {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+
+    struct stat status;
+    if (::fstat(descriptor, &status) != 0)
+    {
+      int const error = errno;
+      ::close(descriptor);
+      throw std::system_error(error, std::generic_category(), path);
+    }
+    m_size = static_cast<size_t>(status.st_size);
+
+    if (m_size > 0)
+    {
+      void *const data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+      if (data == MAP_FAILED)
+      {
+        int const error = errno;
+        ::close(descriptor);
+        throw std::system_error(error, std::generic_category(), path);
+      }
+      ::madvise(data, m_size, MADV_SEQUENTIAL);
+      m_data = static_cast<char const *>(data);
+    }
+    // The mapping holds its own reference to the file.
+    ::close(descriptor);
+#endif
+  };
+
+  mapped_file(mapped_file const &) = delete;
+  mapped_file &operator=(mapped_file const &) = delete;
+
+  ~mapped_file()
+  {
+#if defined(_WIN32)
+    if (m_data != nullptr)
+    {
+      UnmapViewOfFile(m_data);
+      CloseHandle(m_mapping);
+    }
+    CloseHandle(m_file);
+#else
+    if (m_data != nullptr)
+    {
+      ::munmap(const_cast<char *>(m_data), m_size);
+    }
+#endif
+  };
+
+  std::string_view contents() const noexcept
+  {
+    return std::string_view(m_data, m_size);
+  };
+
+private:
+
+  char const *m_data = nullptr;
+  size_t m_size = 0;
+#if defined(_WIN32)
+  HANDLE m_file = INVALID_HANDLE_VALUE;
+  HANDLE m_mapping = nullptr;
+#endif
+};
+
+// Reads URIs from a source that delivers its input a chunk at a time, such as
+// a pipe or socket. source(buffer, capacity) fills up to capacity bytes of
+// buffer and returns how many it wrote, or 0 at the end of the input; for a
+// file descriptor that's just a call to read(). Lines are parsed in place in
+// the reader's buffer. A line that spans two chunks is moved to the front of
+// the buffer before the next chunk is read after it, and the buffer only grows
+// when a single line is longer than it. Records are only valid until the next
+// call to next() or the next callback.
+class uri_chunk_reader
+{
+public:
+
+  using source_type = std::function<size_t(char *, size_t)>;
+
+  explicit uri_chunk_reader(source_type source, size_t buffer_size = (1 << 20),
+                            uri::scheme_category category = uri::scheme_category::Hierarchical,
+                            uri::query_argument_separator separator = uri::query_argument_separator::ampersand) :
+    m_source(std::move(source)),
+    m_buffer(std::max<size_t>(buffer_size, 1)),
+    m_begin(0),
+    m_end(0),
+    m_exhausted(false),
+    m_category(category),
+    m_separator(separator)
+  { };
+
+  // Reads the next record; returns false at the end of the input.
+  bool next(uri_record &record)
+  {
+    std::string_view line;
+    while (true)
+    {
+      std::string_view const pending(m_buffer.data(), m_end);
+      if (uri_detail::next_line(pending, m_begin, line, !m_exhausted))
+      {
+        uri_detail::parse_record(line, m_category, m_separator, record);
+        return true;
+      }
+
+      if (m_exhausted)
+      {
+        return false;
+      }
+      refill();
+    }
+  };
+
+  // Calls callback(record) for every remaining record.
+  template <typename Callback>
+  void for_each(Callback &&callback)
+  {
+    uri_record record;
+    while (next(record))
+    {
+      callback(static_cast<uri_record const &>(record));
+    }
+  };
+
+private:
+
+  void refill()
+  {
+    // Keep the partial line at the end of the buffer by moving it to the
+    // front, and grow the buffer if that line already fills it.
+    size_t const partial = m_end - std::min(m_begin, m_end);
+    if (partial > 0)
+    {
+      std::memmove(m_buffer.data(), (m_buffer.data() + m_begin), partial);
+    }
+    m_begin = 0;
+    m_end = partial;
+    if (m_end == m_buffer.size())
+    {
+      m_buffer.resize(m_buffer.size() * 2);
+    }
+
+    size_t const read = m_source((m_buffer.data() + m_end), (m_buffer.size() - m_end));
+    m_end += read;
+    m_exhausted = (read == 0);
+  };
+
+  source_type m_source;
+  std::vector<char> m_buffer;
+  size_t m_begin;
+  size_t m_end;
+  bool m_exhausted;
+  uri::scheme_category m_category;
+  uri::query_argument_separator m_separator;
+};
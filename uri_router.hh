@@ -0,0 +1,586 @@
+// Copyright (C) 2015 Ben Lewis <benjf5+github@gmail.com>
+// Licensed under the MIT license.
+
+#pragma once
+#include "uri.hh"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A rule for uri_router: a pattern and the ID to return for URIs it matches.
+struct uri_route
+{
+  std::string_view pattern;
+  std::uint32_t id;
+};
+
+/* Matches URIs against a large set of scheme, host and path prefix rules at
+ * once. Patterns are written as
+ *
+ *     scheme://host/path?key&key=value
+ *
+ * where the scheme may be "*" or left out along with its "://" to match any
+ * scheme; the host may be "*" for any host, "*.example.com" for any host
+ * under example.com (but not example.com itself), or a host to match
+ * exactly, without regard to ASCII case; the path is a prefix matched by
+ * whole segments, so "/api" matches "/api" and "/api/users" but not
+ * "/apis"; and the query, if any, lists keys the URI's query must have,
+ * optionally with the value each must have. Ports aren't matched.
+ *
+ * The rules are compiled into a trie of host labels, read from the last
+ * label of the host to the first, whose nodes lead to tries of path
+ * segments, so matching a URI takes a lookup per label and segment rather
+ * than a comparison per rule. When several rules match, the most specific
+ * wins: an exact host over a wildcard, a longer wildcard over a shorter one
+ * and either over any host; then the longest path prefix; then the rule with
+ * the most query keys, then one naming the scheme, then the first given.
+ */
+class uri_router
+{
+public:
+
+  // A router without rules, which matches nothing.
+  uri_router()
+  {
+    m_hosts.push_back(host_node{});
+  };
+
+  // Compiles a set of rules; a malformed pattern throws std::invalid_argument.
+  explicit uri_router(std::span<uri_route const> routes)
+  {
+    host_builder root;
+    for (size_t order = 0; order < routes.size(); ++order)
+    {
+      add_route(root, routes[order], static_cast<std::uint32_t>(order));
+    }
+    m_rule_count = routes.size();
+    compile(root);
+  };
+
+  // The ID of the best rule matching a URI, if any rule matches. Matching
+  // changes neither the router nor the URI, so any number of threads may
+  // match at once, even against the same uri.
+  std::optional<std::uint32_t> match(uri const &value) const
+  {
+    return match_uri(value);
+  };
+
+  std::optional<std::uint32_t> match(uri_view const &value) const
+  {
+    return match_uri(value);
+  };
+
+  // The number of rules, and the bytes the compiled tries occupy.
+  size_t size() const noexcept
+  {
+    return m_rule_count;
+  };
+
+  size_t memory_usage() const noexcept
+  {
+    return sizeof(*this) + (m_hosts.capacity() * sizeof(host_node)) + (m_paths.capacity() * sizeof(path_node))
+      + (m_rules.capacity() * sizeof(rule_entry)) + (m_predicates.capacity() * sizeof(predicate))
+      + m_text.capacity();
+  };
+
+private:
+
+  static constexpr std::uint32_t no_node = UINT32_MAX;
+
+  // Nodes of both tries keep their label as a span of m_text, and their
+  // children together, sorted by label, so they can be binary searched. The
+  // first eight bytes of the label are kept in the node too, so that most
+  // comparisons are settled without reading m_text.
+  struct host_node
+  {
+    std::uint64_t label_prefix = 0;
+    std::uint32_t label_offset = 0;
+    std::uint32_t label_length = 0;
+    std::uint32_t first_child = 0;
+    std::uint32_t child_count = 0;
+    std::uint32_t parent = 0;
+    // The roots of the path tries for rules on exactly this host, and on
+    // hosts under it; for the root, the first is for rules on any host.
+    std::uint32_t exact_paths = no_node;
+    std::uint32_t wildcard_paths = no_node;
+  };
+
+  struct path_node
+  {
+    std::uint64_t label_prefix = 0;
+    std::uint32_t label_offset = 0;
+    std::uint32_t label_length = 0;
+    std::uint32_t first_child = 0;
+    std::uint32_t child_count = 0;
+    std::uint32_t first_rule = 0;
+    std::uint32_t rule_count = 0;
+  };
+
+  // A scheme of length 0 matches any scheme.
+  struct rule_entry
+  {
+    std::uint32_t id = 0;
+    std::uint32_t scheme_offset = 0;
+    std::uint32_t scheme_length = 0;
+    std::uint32_t first_predicate = 0;
+    std::uint32_t predicate_count = 0;
+  };
+
+  struct predicate
+  {
+    std::uint32_t key_offset = 0;
+    std::uint32_t key_length = 0;
+    std::uint32_t value_offset = 0;
+    std::uint32_t value_length = 0;
+    bool any_value = true;
+  };
+
+  struct rule_builder
+  {
+    std::uint32_t id;
+    std::uint32_t order;
+    std::string scheme;
+    std::vector<std::pair<std::string, std::optional<std::string>>> predicates;
+  };
+
+  struct path_builder
+  {
+    std::map<std::string, path_builder, std::less<>> children;
+    std::vector<rule_builder> rules;
+  };
+
+  struct host_builder
+  {
+    std::map<std::string, host_builder, std::less<>> children;
+    std::unique_ptr<path_builder> exact;
+    std::unique_ptr<path_builder> wildcard;
+  };
+
+  std::vector<host_node> m_hosts;
+  std::vector<path_node> m_paths;
+  std::vector<rule_entry> m_rules;
+  std::vector<predicate> m_predicates;
+  std::string m_text;
+  size_t m_rule_count = 0;
+
+  static char to_lower(char c) noexcept
+  {
+    return ((c >= 'A') && (c <= 'Z')) ? static_cast<char>(c | 0x20) : c;
+  };
+
+  static std::string lowercase(std::string_view text)
+  {
+    std::string folded(text);
+    std::transform(folded.begin(), folded.end(), folded.begin(), to_lower);
+    return folded;
+  };
+
+  static std::string_view trim_root(std::string_view host) noexcept
+  {
+    return (!host.empty() && (host.back() == '.')) ? host.substr(0, (host.length() - 1)) : host;
+  };
+
+  static void add_route(host_builder &root, uri_route const &route, std::uint32_t order)
+  {
+    std::string_view rest = route.pattern;
+    rule_builder rule{ route.id, order, std::string(), {} };
+
+    size_t const scheme_end = rest.find("://");
+    if ((scheme_end != std::string_view::npos) && (scheme_end < rest.find_first_of("/?")))
+    {
+      std::string_view const scheme = rest.substr(0, scheme_end);
+      if (scheme != "*")
+      {
+        rule.scheme = lowercase(scheme);
+      }
+      rest.remove_prefix(scheme_end + 3);
+    }
+
+    size_t const query_start = rest.find('?');
+    if (query_start != std::string_view::npos)
+    {
+      std::string_view query = rest.substr(query_start + 1);
+      rest = rest.substr(0, query_start);
+      while (!query.empty())
+      {
+        size_t const separator = query.find('&');
+        std::string_view const parameter = query.substr(0, separator);
+        size_t const equals = parameter.find('=');
+        if (parameter.empty() || (equals == 0))
+        {
+          throw std::invalid_argument("A route's query lists an empty key.");
+        }
+        rule.predicates.emplace_back(std::string(parameter.substr(0, equals)),
+                                     (equals == std::string_view::npos) ? std::optional<std::string>()
+                                                                        : std::string(parameter.substr(equals + 1)));
+        query = (separator == std::string_view::npos) ? std::string_view() : query.substr(separator + 1);
+      }
+    }
+
+    size_t const path_start = rest.find('/');
+    std::string_view host = trim_root(rest.substr(0, path_start));
+    std::string_view path = (path_start == std::string_view::npos) ? std::string_view() : rest.substr(path_start + 1);
+    if (host.empty())
+    {
+      throw std::invalid_argument("A route must name a host, or \"*\" for any host.");
+    }
+    if ((host.find(':') != std::string_view::npos) && (host.front() != '['))
+    {
+      throw std::invalid_argument("A route cannot match on a port.");
+    }
+
+    // Find the host's node, making it if need be; a wildcard rule hangs off
+    // the node of the domain it covers.
+    host_builder *current = &root;
+    bool const wildcard = (host.substr(0, 2) == "*.");
+    if (host != "*")
+    {
+      host = wildcard ? host.substr(2) : host;
+      while (!host.empty())
+      {
+        size_t const dot = host.rfind('.');
+        std::string label = lowercase(host.substr((dot == std::string_view::npos) ? 0 : (dot + 1)));
+        if (label.empty() || (label.find('*') != std::string::npos))
+        {
+          throw std::invalid_argument("A route's host has an empty label, or a '*' other than at its start.");
+        }
+        current = &current->children[label];
+        host = host.substr(0, ((dot == std::string_view::npos) ? 0 : dot));
+      }
+    }
+    std::unique_ptr<path_builder> &paths = wildcard ? current->wildcard : current->exact;
+    if (!paths)
+    {
+      paths = std::make_unique<path_builder>();
+    }
+
+    // A trailing '/' adds nothing to a prefix, so "/api/" is "/api".
+    path_builder *node = paths.get();
+    while (!path.empty())
+    {
+      size_t const slash = path.find('/');
+      node = &node->children[std::string(path.substr(0, slash))];
+      path = (slash == std::string_view::npos) ? std::string_view() : path.substr(slash + 1);
+    }
+    node->rules.push_back(std::move(rule));
+  };
+
+  std::uint32_t add_text(std::string_view text)
+  {
+    if (text.length() > (UINT32_MAX - m_text.length()))
+    {
+      throw std::length_error("A uri_router's rules can hold at most 4 GiB of text.");
+    }
+    std::uint32_t const offset = static_cast<std::uint32_t>(m_text.length());
+    m_text.append(text);
+    return offset;
+  };
+
+  // Lays the host trie out breadth-first, so every node's children are
+  // adjacent, and each path trie after it in the same way.
+  void compile(host_builder const &root)
+  {
+    std::vector<host_builder const *> pending{ &root };
+    m_hosts.push_back(host_node{});
+    for (size_t index = 0; index < pending.size(); ++index)
+    {
+      host_builder const &current = *pending[index];
+      m_hosts[index].first_child = static_cast<std::uint32_t>(m_hosts.size());
+      m_hosts[index].child_count = static_cast<std::uint32_t>(current.children.size());
+      m_hosts[index].exact_paths = current.exact ? compile_paths(*current.exact) : no_node;
+      m_hosts[index].wildcard_paths = current.wildcard ? compile_paths(*current.wildcard) : no_node;
+      for (auto const &[label, child] : current.children)
+      {
+        host_node compiled;
+        compiled.label_prefix = prefix_of(label, false);
+        compiled.label_offset = add_text(label);
+        compiled.label_length = static_cast<std::uint32_t>(label.length());
+        compiled.parent = static_cast<std::uint32_t>(index);
+        m_hosts.push_back(compiled);
+        pending.push_back(&child);
+      }
+    }
+    m_hosts.shrink_to_fit();
+    m_paths.shrink_to_fit();
+    m_rules.shrink_to_fit();
+    m_predicates.shrink_to_fit();
+    m_text.shrink_to_fit();
+  };
+
+  std::uint32_t compile_paths(path_builder const &root)
+  {
+    std::uint32_t const root_index = static_cast<std::uint32_t>(m_paths.size());
+    std::vector<path_builder const *> pending{ &root };
+    m_paths.push_back(path_node{});
+    for (size_t index = 0; index < pending.size(); ++index)
+    {
+      path_builder const &current = *pending[index];
+      path_node &node = m_paths[root_index + index];
+      node.first_child = static_cast<std::uint32_t>(m_paths.size());
+      node.child_count = static_cast<std::uint32_t>(current.children.size());
+      compile_rules(current.rules, node);
+      for (auto const &[segment, child] : current.children)
+      {
+        path_node compiled;
+        compiled.label_prefix = prefix_of(segment, false);
+        compiled.label_offset = add_text(segment);
+        compiled.label_length = static_cast<std::uint32_t>(segment.length());
+        m_paths.push_back(compiled);
+        pending.push_back(&child);
+      }
+    }
+    return root_index;
+  };
+
+  // Orders a node's rules from most to least specific, so that matching can
+  // stop at the first one that applies.
+  void compile_rules(std::vector<rule_builder> const &rules, path_node &node)
+  {
+    std::vector<rule_builder const *> sorted;
+    for (rule_builder const &rule : rules)
+    {
+      sorted.push_back(&rule);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](rule_builder const *left, rule_builder const *right) {
+      if (left->predicates.size() != right->predicates.size())
+      {
+        return left->predicates.size() > right->predicates.size();
+      }
+      if (left->scheme.empty() != right->scheme.empty())
+      {
+        return !left->scheme.empty();
+      }
+      return left->order < right->order;
+    });
+
+    node.first_rule = static_cast<std::uint32_t>(m_rules.size());
+    node.rule_count = static_cast<std::uint32_t>(sorted.size());
+    for (rule_builder const *rule : sorted)
+    {
+      rule_entry compiled;
+      compiled.id = rule->id;
+      compiled.scheme_offset = add_text(rule->scheme);
+      compiled.scheme_length = static_cast<std::uint32_t>(rule->scheme.length());
+      compiled.first_predicate = static_cast<std::uint32_t>(m_predicates.size());
+      compiled.predicate_count = static_cast<std::uint32_t>(rule->predicates.size());
+      for (auto const &[key, value] : rule->predicates)
+      {
+        predicate condition;
+        condition.key_offset = add_text(key);
+        condition.key_length = static_cast<std::uint32_t>(key.length());
+        condition.any_value = !value;
+        condition.value_offset = add_text(value ? *value : std::string());
+        condition.value_length = static_cast<std::uint32_t>(value ? value->length() : 0);
+        m_predicates.push_back(condition);
+      }
+      m_rules.push_back(compiled);
+    }
+  };
+
+  std::string_view text(std::uint32_t offset, std::uint32_t length) const noexcept
+  {
+    return std::string_view((m_text.data() + offset), length);
+  };
+
+  // Compares a stored label with one from a URI; host labels are stored in
+  // lowercase, and the URI's folded to match.
+  static int compare_label(std::string_view stored, std::string_view label, bool fold_case) noexcept
+  {
+    size_t const length = std::min(stored.length(), label.length());
+    for (size_t index = 0; index < length; ++index)
+    {
+      unsigned char const left = static_cast<unsigned char>(stored[index]);
+      unsigned char const right = static_cast<unsigned char>(fold_case ? to_lower(label[index]) : label[index]);
+      if (left != right)
+      {
+        return (left < right) ? -1 : 1;
+      }
+    }
+    return (stored.length() == label.length()) ? 0 : ((stored.length() < label.length()) ? -1 : 1);
+  };
+
+  // The first eight bytes of a label, packed so that comparing two prefixes
+  // as integers orders them as the labels' bytes would be.
+  static std::uint64_t prefix_of(std::string_view label, bool fold_case) noexcept
+  {
+    std::uint64_t prefix = 0;
+    for (size_t index = 0; index < 8; ++index)
+    {
+      char const c = (index < label.length()) ? (fold_case ? to_lower(label[index]) : label[index]) : '\0';
+      prefix = (prefix << 8) | static_cast<unsigned char>(c);
+    }
+    return prefix;
+  };
+
+  template <typename Node>
+  std::uint32_t find_child(std::vector<Node> const &nodes, Node const &parent, std::string_view label,
+                           bool fold_case) const noexcept
+  {
+    std::uint64_t const prefix = prefix_of(label, fold_case);
+    size_t low = parent.first_child;
+    size_t high = parent.first_child + parent.child_count;
+    while (low < high)
+    {
+      size_t const middle = low + ((high - low) / 2);
+      Node const &node = nodes[middle];
+      int order = (node.label_prefix < prefix) ? -1 : ((node.label_prefix > prefix) ? 1 : 0);
+      if ((order == 0) && ((node.label_length > 8) || (label.length() > 8)))
+      {
+        order = compare_label(text(node.label_offset, node.label_length), label, fold_case);
+      }
+      else if (order == 0)
+      {
+        order = (node.label_length == label.length()) ? 0 : ((node.label_length < label.length()) ? -1 : 1);
+      }
+      if (order == 0)
+      {
+        return static_cast<std::uint32_t>(middle);
+      }
+      if (order < 0)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+    return no_node;
+  };
+
+  template <typename Uri>
+  std::optional<std::uint32_t> match_uri(Uri const &value) const
+  {
+    if ((value.get_scheme_category() != uri::scheme_category::Hierarchical) || (m_rule_count == 0))
+    {
+      return std::nullopt;
+    }
+
+    // Follow the host's labels from the last as far as the trie goes.
+    std::string_view const host = trim_root(value.get_host());
+    std::uint32_t deepest = 0;
+    size_t end = host.length();
+    bool whole_host = host.empty();
+    while (!host.empty())
+    {
+      size_t const dot = (end == 0) ? std::string_view::npos : host.rfind('.', (end - 1));
+      size_t const start = (dot == std::string_view::npos) ? 0 : (dot + 1);
+      std::uint32_t const child = find_child(m_hosts, m_hosts[deepest], host.substr(start, (end - start)), true);
+      if (child == no_node)
+      {
+        break;
+      }
+      deepest = child;
+      if (dot == std::string_view::npos)
+      {
+        whole_host = true;
+        break;
+      }
+      end = dot;
+    }
+
+    // Try the hosts' path tries from the most specific: the exact host, then
+    // each wildcard from the longest, then any host.
+    if (whole_host && (deepest != 0))
+    {
+      if (std::optional<std::uint32_t> const id = match_paths(m_hosts[deepest].exact_paths, value))
+      {
+        return id;
+      }
+      deepest = m_hosts[deepest].parent;
+    }
+    for (std::uint32_t node = deepest; node != 0; node = m_hosts[node].parent)
+    {
+      if (std::optional<std::uint32_t> const id = match_paths(m_hosts[node].wildcard_paths, value))
+      {
+        return id;
+      }
+    }
+    return match_paths(m_hosts[0].exact_paths, value);
+  };
+
+  // Walks a path trie along the URI's segments, keeping the deepest rule that
+  // applies.
+  template <typename Uri>
+  std::optional<std::uint32_t> match_paths(std::uint32_t root, Uri const &value) const
+  {
+    if (root == no_node)
+    {
+      return std::nullopt;
+    }
+
+    std::optional<std::uint32_t> best = match_rules(m_paths[root], value);
+    std::uint32_t node = root;
+    for (std::string_view const segment : value.get_path_segments())
+    {
+      node = find_child(m_paths, m_paths[node], segment, false);
+      if (node == no_node)
+      {
+        break;
+      }
+      if (std::optional<std::uint32_t> const id = match_rules(m_paths[node], value))
+      {
+        best = id;
+      }
+    }
+    return best;
+  };
+
+  template <typename Uri>
+  std::optional<std::uint32_t> match_rules(path_node const &node, Uri const &value) const
+  {
+    for (std::uint32_t index = node.first_rule; index < (node.first_rule + node.rule_count); ++index)
+    {
+      rule_entry const &rule = m_rules[index];
+      if ((rule.scheme_length != 0)
+          && (compare_label(text(rule.scheme_offset, rule.scheme_length), value.get_scheme(), true) != 0))
+      {
+        continue;
+      }
+
+      bool satisfied = true;
+      for (std::uint32_t condition = rule.first_predicate;
+           satisfied && (condition < (rule.first_predicate + rule.predicate_count)); ++condition)
+      {
+        predicate const &required = m_predicates[condition];
+        std::optional<std::string_view> const found =
+          find_query_param(value, text(required.key_offset, required.key_length));
+        satisfied = found && (required.any_value || (*found == text(required.value_offset, required.value_length)));
+      }
+      if (satisfied)
+      {
+        return rule.id;
+      }
+    }
+    return std::nullopt;
+  };
+
+  // Scans the query itself, as uri_view::find_query_param does, rather than
+  // through uri's lazily built index, so that one uri can be matched from
+  // several threads at once.
+  template <typename Uri>
+  static std::optional<std::string_view> find_query_param(Uri const &value, std::string_view key) noexcept
+  {
+    std::string_view const query = value.get_query();
+    if (!query.empty())
+    {
+      size_t carat = 0;
+      uri::query_entry entry;
+      while (uri::next_query_parameter(query, value.m_separator, carat, entry))
+      {
+        if (query.substr(entry.key_offset, entry.key_length) == key)
+        {
+          return query.substr(entry.value_offset, entry.value_length);
+        }
+      }
+    }
+    return std::nullopt;
+  };
+};
@@ -0,0 +1,652 @@
+// Copyright (C) 2015 Ben Lewis <benjf5+github@gmail.com>
+// Licensed under the MIT license.
+
+#pragma once
+#include "uri.hh"
+#include "uri_batch.hh"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The Arrow C data interface (https://arrow.apache.org/docs/format/CDataInterface.html),
+// declared as the specification asks, so that programs already including
+// Arrow's own headers see one definition.
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema
+{
+  const char *format;
+  const char *name;
+  const char *metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema **children;
+  struct ArrowSchema *dictionary;
+  void (*release)(struct ArrowSchema *);
+  void *private_data;
+};
+
+struct ArrowArray
+{
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void **buffers;
+  struct ArrowArray **children;
+  struct ArrowArray *dictionary;
+  void (*release)(struct ArrowArray *);
+  void *private_data;
+};
+
+#endif
+
+/* A table of URIs stored by column rather than by row: the scheme ID and port
+ * of every URI are each held in one array, and the scheme, host, path, query
+ * and fragment each in one buffer of bytes with an array of offsets into it,
+ * as Arrow lays out string columns. Scanning one component of many URIs then
+ * reads memory in order, and the columns can be handed to Arrow without
+ * copying. Rows are appended from text, parsed by the same code as uri_view,
+ * or from views that have already been parsed.
+ */
+class uri_table
+{
+public:
+
+  // One of the table's string columns: entry i is the bytes from offsets()[i]
+  // to offsets()[i + 1] of bytes(). Absent components are empty strings.
+  class string_column
+  {
+  public:
+
+    class const_iterator
+    {
+    public:
+
+      using iterator_category = std::random_access_iterator_tag;
+      using value_type = std::string_view;
+      using difference_type = std::ptrdiff_t;
+      using pointer = void;
+      using reference = std::string_view;
+
+      const_iterator() noexcept :
+        m_column(nullptr),
+        m_index(0)
+      { };
+
+      std::string_view operator*() const noexcept
+      {
+        return (*m_column)[m_index];
+      };
+
+      std::string_view operator[](difference_type distance) const noexcept
+      {
+        return (*m_column)[m_index + distance];
+      };
+
+      const_iterator &operator++() noexcept
+      {
+        ++m_index;
+        return *this;
+      };
+
+      const_iterator operator++(int) noexcept
+      {
+        const_iterator const previous = *this;
+        ++m_index;
+        return previous;
+      };
+
+      const_iterator &operator--() noexcept
+      {
+        --m_index;
+        return *this;
+      };
+
+      const_iterator operator--(int) noexcept
+      {
+        const_iterator const previous = *this;
+        --m_index;
+        return previous;
+      };
+
+      const_iterator &operator+=(difference_type distance) noexcept
+      {
+        m_index += distance;
+        return *this;
+      };
+
+      const_iterator &operator-=(difference_type distance) noexcept
+      {
+        m_index -= distance;
+        return *this;
+      };
+
+      friend const_iterator operator+(const_iterator it, difference_type distance) noexcept
+      {
+        return it += distance;
+      };
+
+      friend const_iterator operator+(difference_type distance, const_iterator it) noexcept
+      {
+        return it += distance;
+      };
+
+      friend const_iterator operator-(const_iterator it, difference_type distance) noexcept
+      {
+        return it -= distance;
+      };
+
+      friend difference_type operator-(const_iterator const &left, const_iterator const &right) noexcept
+      {
+        return static_cast<difference_type>(left.m_index) - static_cast<difference_type>(right.m_index);
+      };
+
+      friend bool operator==(const_iterator const &left, const_iterator const &right) noexcept
+      {
+        return left.m_index == right.m_index;
+      };
+
+      friend auto operator<=>(const_iterator const &left, const_iterator const &right) noexcept
+      {
+        return left.m_index <=> right.m_index;
+      };
+
+    private:
+
+      friend class string_column;
+
+      const_iterator(string_column const *column, size_t index) noexcept :
+        m_column(column),
+        m_index(index)
+      { };
+
+      string_column const *m_column;
+      size_t m_index;
+    };
+
+    size_t size() const noexcept
+    {
+      return m_offsets.size() - 1;
+    };
+
+    bool empty() const noexcept
+    {
+      return size() == 0;
+    };
+
+    std::string_view operator[](size_t index) const noexcept
+    {
+      return std::string_view((m_bytes.data() + m_offsets[index]),
+                              static_cast<size_t>(m_offsets[index + 1] - m_offsets[index]));
+    };
+
+    const_iterator begin() const noexcept
+    {
+      return const_iterator(this, 0);
+    };
+
+    const_iterator end() const noexcept
+    {
+      return const_iterator(this, size());
+    };
+
+    // size() + 1 offsets, starting at 0.
+    std::span<std::int32_t const> offsets() const noexcept
+    {
+      return m_offsets;
+    };
+
+    std::span<char const> bytes() const noexcept
+    {
+      return std::span<char const>(m_bytes.data(), m_bytes.size());
+    };
+
+  private:
+
+    friend class uri_table;
+
+    string_column() :
+      m_offsets(1, 0)
+    { };
+
+    // Makes room for one more row holding text, so that push_back can't fail.
+    void make_room(std::string_view text)
+    {
+      if (text.length() > (static_cast<size_t>(std::numeric_limits<std::int32_t>::max()) - m_bytes.size()))
+      {
+        throw std::length_error("A uri_table column can hold at most 2 GiB of text.");
+      }
+      uri_table::make_room(m_offsets, 1);
+      uri_table::make_room(m_bytes, text.length());
+    };
+
+    void push_back(std::string_view text) noexcept
+    {
+      m_bytes.append(text);
+      m_offsets.push_back(static_cast<std::int32_t>(m_bytes.size()));
+    };
+
+    void truncate(size_t rows) noexcept
+    {
+      m_bytes.resize(static_cast<size_t>(m_offsets[rows]));
+      m_offsets.resize(rows + 1);
+    };
+
+    void clear() noexcept
+    {
+      m_offsets.resize(1);
+      m_bytes.clear();
+    };
+
+    size_t memory_usage() const noexcept
+    {
+      return (m_offsets.capacity() * sizeof(std::int32_t)) + m_bytes.capacity();
+    };
+
+    std::vector<std::int32_t> m_offsets;
+    std::string m_bytes;
+  };
+
+  uri_table() = default;
+
+  void reserve(size_t rows)
+  {
+    m_scheme_ids.reserve(rows);
+    m_ports.reserve(rows);
+    m_port_validity.reserve((rows + 7) / 8);
+    for (string_column *column : { &m_schemes, &m_hosts, &m_paths, &m_queries, &m_fragments })
+    {
+      column->m_offsets.reserve(rows + 1);
+    }
+  };
+
+  /* Parses a URI and appends it as a new row, returning parse_error::none; a
+   * malformed URI is left out, and its error returned. The content of a
+   * non-hierarchical URI goes in the path column, and it has no host or port.
+   */
+  uri::parse_error append(std::string_view uri_text,
+                          uri::scheme_category category = uri::scheme_category::Hierarchical,
+                          uri::query_argument_separator separator = uri::query_argument_separator::ampersand)
+  {
+    uri::parse_result<uri_view> const result = uri_view::try_parse(uri_text, category, separator);
+    if (result)
+    {
+      append(*result);
+    }
+    return result.error();
+  };
+
+  /* Appends a URI that has already been parsed. Every column is given room
+   * for the row before any of them changes, so if the row can't be added (a
+   * column would pass 2 GiB of text, or memory runs out) the table is left
+   * as it was.
+   */
+  void append(uri_view const &view)
+  {
+    bool const hierarchical = (view.get_scheme_category() == uri::scheme_category::Hierarchical);
+    std::uint16_t const port = hierarchical ? static_cast<std::uint16_t>(view.get_port()) : 0;
+    std::string_view const host = hierarchical ? view.get_host() : std::string_view();
+    std::string_view const path = hierarchical ? view.get_path() : view.get_content();
+    size_t const row = size();
+
+    m_schemes.make_room(view.get_scheme());
+    m_hosts.make_room(host);
+    m_paths.make_room(path);
+    m_queries.make_room(view.get_query());
+    m_fragments.make_room(view.get_fragment());
+    make_room(m_ports, 1);
+    make_room(m_scheme_ids, 1);
+    make_room(m_port_validity, ((row % 8) == 0) ? 1 : 0);
+
+    // Nothing from here on allocates, so nothing can fail.
+    if ((row % 8) == 0)
+    {
+      m_port_validity.push_back(0);
+    }
+    if (port != 0)
+    {
+      m_port_validity.back() |= static_cast<std::uint8_t>(1u << (row % 8));
+    }
+    else
+    {
+      ++m_port_null_count;
+    }
+    m_ports.push_back(port);
+    m_scheme_ids.push_back(view.get_known_scheme());
+    m_schemes.push_back(view.get_scheme());
+    m_hosts.push_back(host);
+    m_paths.push_back(path);
+    m_queries.push_back(view.get_query());
+    m_fragments.push_back(view.get_fragment());
+  };
+
+  /* Parses many URIs with parse_batch, which may spread them across a thread
+   * pool, and appends those that parse in their input order. Returns the
+   * number that failed and were left out. If any row can't be added, none of
+   * them are.
+   */
+  size_t append(std::span<std::string_view const> inputs, parse_batch_options const &options = {})
+  {
+    size_t const failures = parse_batch(inputs, m_scratch, options);
+    size_t const rows = size();
+    try
+    {
+      for (size_t index = 0; index < inputs.size(); ++index)
+      {
+        if (m_scratch.error(index) == uri::parse_error::none)
+        {
+          append(m_scratch.view(index));
+        }
+      }
+    }
+    catch (...)
+    {
+      truncate(rows);
+      throw;
+    }
+    return failures;
+  };
+
+  size_t size() const noexcept
+  {
+    return m_scheme_ids.size();
+  };
+
+  bool empty() const noexcept
+  {
+    return m_scheme_ids.empty();
+  };
+
+  void clear() noexcept
+  {
+    m_scheme_ids.clear();
+    m_ports.clear();
+    m_port_validity.clear();
+    m_port_null_count = 0;
+    for (string_column *column : { &m_schemes, &m_hosts, &m_paths, &m_queries, &m_fragments })
+    {
+      column->clear();
+    }
+  };
+
+  std::span<uri::known_scheme const> scheme_ids() const noexcept
+  {
+    return m_scheme_ids;
+  };
+
+  string_column const &schemes() const noexcept
+  {
+    return m_schemes;
+  };
+
+  string_column const &hosts() const noexcept
+  {
+    return m_hosts;
+  };
+
+  // Each row's port, or 0 where the URI has none (or gives it as 0).
+  std::span<std::uint16_t const> ports() const noexcept
+  {
+    return m_ports;
+  };
+
+  bool has_port(size_t row) const noexcept
+  {
+    return (m_port_validity[row / 8] >> (row % 8)) & 1;
+  };
+
+  string_column const &paths() const noexcept
+  {
+    return m_paths;
+  };
+
+  string_column const &queries() const noexcept
+  {
+    return m_queries;
+  };
+
+  string_column const &fragments() const noexcept
+  {
+    return m_fragments;
+  };
+
+  // The bytes taken by the table's columns, and by the batch it parses into.
+  size_t memory_usage() const noexcept
+  {
+    size_t total = sizeof(*this) - sizeof(m_scratch) + m_scratch.memory_usage() + m_scheme_ids.capacity()
+      + (m_ports.capacity() * sizeof(std::uint16_t)) + m_port_validity.capacity();
+    for (string_column const *column : { &m_schemes, &m_hosts, &m_paths, &m_queries, &m_fragments })
+    {
+      total += column->memory_usage();
+    }
+    return total;
+  };
+
+  /* Exports the table through the Arrow C data interface as a struct array
+   * with the columns scheme_id (uint8, the uri::known_scheme values), scheme,
+   * host, port (uint16, null where absent), path, query and fragment. The
+   * parser doesn't check that text is UTF-8, so the text columns are exported
+   * as binary.
+   * The exported arrays point straight at the table's buffers, so the table
+   * must outlive them and not be changed until they have been released.
+   * Children may be moved out and released on their own, as the interface
+   * allows.
+   */
+  void export_to_arrow(ArrowArray *out_array, ArrowSchema *out_schema) const
+  {
+    root_schema_data *schema_data = new root_schema_data();
+    root_array_data *array_data = nullptr;
+    try
+    {
+      array_data = new root_array_data();
+      for (size_t index = 0; index < column_count; ++index)
+      {
+        array_data->children[index] = ArrowArray{};
+        array_data->child_pointers[index] = &array_data->children[index];
+        schema_data->child_pointers[index] = &schema_data->children[index];
+      }
+
+      export_primitive(array_data->children[0], schema_data->children[0], "scheme_id", "C",
+                       m_scheme_ids.data(), nullptr, 0);
+      export_string(array_data->children[1], schema_data->children[1], "scheme", m_schemes);
+      export_string(array_data->children[2], schema_data->children[2], "host", m_hosts);
+      export_primitive(array_data->children[3], schema_data->children[3], "port", "S", m_ports.data(),
+                       m_port_validity.data(), m_port_null_count);
+      export_string(array_data->children[4], schema_data->children[4], "path", m_paths);
+      export_string(array_data->children[5], schema_data->children[5], "query", m_queries);
+      export_string(array_data->children[6], schema_data->children[6], "fragment", m_fragments);
+    }
+    catch (...)
+    {
+      if (array_data != nullptr)
+      {
+        ArrowArray partial{};
+        partial.n_children = static_cast<int64_t>(column_count);
+        partial.children = array_data->child_pointers.data();
+        partial.private_data = array_data;
+        release_root_array(&partial);
+      }
+      delete schema_data;
+      throw;
+    }
+
+    *out_schema = ArrowSchema{};
+    out_schema->format = "+s";
+    out_schema->name = "";
+    out_schema->n_children = static_cast<int64_t>(column_count);
+    out_schema->children = schema_data->child_pointers.data();
+    out_schema->release = release_root_schema;
+    out_schema->private_data = schema_data;
+
+    *out_array = ArrowArray{};
+    out_array->length = static_cast<int64_t>(size());
+    out_array->n_buffers = 1;
+    out_array->buffers = array_data->buffers.data();
+    out_array->n_children = static_cast<int64_t>(column_count);
+    out_array->children = array_data->child_pointers.data();
+    out_array->release = release_root_array;
+    out_array->private_data = array_data;
+  };
+
+private:
+
+  static constexpr size_t column_count = 7;
+
+  // Grows a column's storage, geometrically, until it has room for extra more
+  // elements.
+  template <typename Column>
+  static void make_room(Column &column, size_t extra)
+  {
+    if ((column.capacity() - column.size()) < extra)
+    {
+      column.reserve(std::max(column.size() + extra, column.capacity() * 2));
+    }
+  };
+
+  // Drops the rows from rows onwards.
+  void truncate(size_t rows) noexcept
+  {
+    for (size_t row = rows; row < size(); ++row)
+    {
+      m_port_null_count -= (m_ports[row] == 0) ? 1 : 0;
+    }
+    m_scheme_ids.resize(rows);
+    m_ports.resize(rows);
+    m_port_validity.resize((rows + 7) / 8);
+    if ((rows % 8) != 0)
+    {
+      m_port_validity.back() &= static_cast<std::uint8_t>((1u << (rows % 8)) - 1);
+    }
+    for (string_column *column : { &m_schemes, &m_hosts, &m_paths, &m_queries, &m_fragments })
+    {
+      column->truncate(rows);
+    }
+  };
+
+  // Each exported child owns its list of buffer pointers, so that it can
+  // outlive the struct array it came from.
+  struct child_array_data
+  {
+    std::array<void const *, 3> buffers{};
+  };
+
+  struct root_array_data
+  {
+    std::array<ArrowArray, column_count> children;
+    std::array<ArrowArray *, column_count> child_pointers;
+    std::array<void const *, 1> buffers{};
+  };
+
+  struct root_schema_data
+  {
+    std::array<ArrowSchema, column_count> children{};
+    std::array<ArrowSchema *, column_count> child_pointers{};
+  };
+
+  static void release_child_array(ArrowArray *array)
+  {
+    delete static_cast<child_array_data *>(array->private_data);
+    array->release = nullptr;
+  };
+
+  static void release_root_array(ArrowArray *array)
+  {
+    for (int64_t index = 0; index < array->n_children; ++index)
+    {
+      ArrowArray *const child = array->children[index];
+      if (child->release != nullptr)
+      {
+        child->release(child);
+      }
+    }
+    delete static_cast<root_array_data *>(array->private_data);
+    array->release = nullptr;
+  };
+
+  static void release_child_schema(ArrowSchema *schema)
+  {
+    schema->release = nullptr;
+  };
+
+  static void release_root_schema(ArrowSchema *schema)
+  {
+    for (int64_t index = 0; index < schema->n_children; ++index)
+    {
+      ArrowSchema *const child = schema->children[index];
+      if (child->release != nullptr)
+      {
+        child->release(child);
+      }
+    }
+    delete static_cast<root_schema_data *>(schema->private_data);
+    schema->release = nullptr;
+  };
+
+  static void export_schema(ArrowSchema &schema, char const *name, char const *format, bool nullable) noexcept
+  {
+    schema.format = format;
+    schema.name = name;
+    schema.flags = nullable ? ARROW_FLAG_NULLABLE : 0;
+    schema.release = release_child_schema;
+  };
+
+  // Arrow asks for non-null data buffers even when a column is empty.
+  static void const *data_or_empty(void const *data) noexcept
+  {
+    static std::int64_t const empty = 0;
+    return (data != nullptr) ? data : &empty;
+  };
+
+  void export_primitive(ArrowArray &array, ArrowSchema &schema, char const *name, char const *format,
+                        void const *values, void const *validity, size_t null_count) const
+  {
+    child_array_data *const data = new child_array_data();
+    data->buffers[0] = (null_count != 0) ? validity : nullptr;
+    data->buffers[1] = data_or_empty(values);
+    array.length = static_cast<int64_t>(size());
+    array.null_count = static_cast<int64_t>(null_count);
+    array.n_buffers = 2;
+    array.buffers = data->buffers.data();
+    array.release = release_child_array;
+    array.private_data = data;
+    export_schema(schema, name, format, (validity != nullptr));
+  };
+
+  void export_string(ArrowArray &array, ArrowSchema &schema, char const *name, string_column const &column) const
+  {
+    child_array_data *const data = new child_array_data();
+    data->buffers[1] = column.m_offsets.data();
+    data->buffers[2] = column.m_bytes.data();
+    array.length = static_cast<int64_t>(size());
+    array.n_buffers = 3;
+    array.buffers = data->buffers.data();
+    array.release = release_child_array;
+    array.private_data = data;
+    export_schema(schema, name, "z", false);
+  };
+
+  std::vector<uri::known_scheme> m_scheme_ids;
+  std::vector<std::uint16_t> m_ports;
+  std::vector<std::uint8_t> m_port_validity;
+  size_t m_port_null_count = 0;
+  string_column m_schemes;
+  string_column m_hosts;
+  string_column m_paths;
+  string_column m_queries;
+  string_column m_fragments;
+  uri_batch m_scratch;
+};